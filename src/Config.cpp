@@ -11,6 +11,16 @@ Config::~Config() { // Destructor
 	free(astruct->trans);
 	free(astruct->a);
 	free(astruct);
+	if(delta_astruct != nullptr) {
+		free(delta_astruct->trans);
+		free(delta_astruct->a);
+		free(delta_astruct);
+	}
+	for(auto & stage : cascade) {
+		free(stage.astruct->trans);
+		free(stage.astruct->a);
+		free(stage.astruct);
+	}
 	if(SEG) {
 		SegParametersFree(blast_seg_params);
 	}
@@ -21,6 +31,17 @@ void Config::init() {
 
 	astruct = alloc_AlphabetStruct(bwt->alphabet,0,0);
 
+	if(delta_bwt != nullptr) {
+		// E-values are calculated for the combined size of both indexes
+		db_length += (double)(delta_bwt->len - delta_bwt->nseq);
+		delta_astruct = alloc_AlphabetStruct(delta_bwt->alphabet,0,0);
+	}
+
+	for(auto & stage : cascade) {
+		stage.db_length = (double)(stage.bwt->len - stage.bwt->nseq);
+		stage.astruct = alloc_AlphabetStruct(stage.bwt->alphabet,0,0);
+	}
+
 	if(SEG) {
 		blast_seg_params = SegParametersNewAa();
 		blast_seg_params->overlaps = TRUE;
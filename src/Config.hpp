@@ -8,12 +8,17 @@
 #include <iostream>
 #include <list>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
 #include <set>
 #include <fstream>
 #include <iterator>
 #include <stdint.h>
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <zlib.h>
 
 #include "include/ncbi-blast+/algo/blast/core/blast_seg.h"
 #include "include/ncbi-blast+/algo/blast/core/blast_filter.h"
@@ -26,7 +31,95 @@ extern "C" {
 }
 
 
-enum Mode { MEM, GREEDY };
+enum Mode { MEM, GREEDY, BNB };
+
+/* output file for reads that are classified to a taxon within the subtree of taxon_id */
+class TaxonBin {
+	public:
+		uint64_t taxon_id;
+		std::pair<uint32_t,uint32_t> interval; // DFS interval of taxon_id, see label_node_intervals()
+		gzFile file1 = NULL;
+		gzFile file2 = NULL; // second read of pairs
+		uint64_t num_reads = 0;
+		TaxonBin(uint64_t id) : taxon_id(id) { }
+};
+
+/* locate cost of one database sequence, accumulated over the sampled suffix array intervals */
+class SeqProfile {
+	public:
+		uint64_t intervals = 0; // number of sampled intervals in which the sequence was located
+		uint64_t rows = 0; // number of rows located by get_suffix()
+		uint64_t interval_size_sum = 0;
+		uint64_t interval_size_max = 0;
+		double seconds = 0.0;
+};
+
+/* output of one batch of reordered reads, which is written once all reads of the batch are classified */
+class ReadBatch {
+	public:
+		std::vector<std::string> output; // output line(s) for each read in input order
+		size_t missing; // number of reads in the batch that are not classified yet
+		ReadBatch(size_t n) : output(n), missing(n) { }
+};
+
+/* log-linear histogram of durations in nanoseconds, with 16 linear buckets for each power of two */
+class LatencyHistogram {
+	public:
+		std::vector<uint64_t> counts = std::vector<uint64_t>(61 * 16, 0);
+		uint64_t num = 0;
+		uint64_t max = 0;
+		void add(uint64_t ns) {
+			counts[bucket(ns)]++;
+			num++;
+			if(ns > max) max = ns;
+		}
+		void merge(const LatencyHistogram & other) {
+			for(size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+			num += other.num;
+			if(other.max > max) max = other.max;
+		}
+		/* returns the upper end of the bucket containing the q-quantile */
+		uint64_t quantile(double q) const {
+			uint64_t rank = (uint64_t)(q * (double)num);
+			uint64_t sum = 0;
+			for(size_t i = 0; i < counts.size(); i++) {
+				sum += counts[i];
+				if(sum > rank) {
+					if(i < 16) return i;
+					const int e = (int)(i / 16) + 3;
+					uint64_t upper = ((16 + i % 16) << (e - 4)) + ((uint64_t)1 << (e - 4)) - 1;
+					return upper < max ? upper : max;
+				}
+			}
+			return max;
+		}
+	private:
+		static size_t bucket(uint64_t ns) {
+			if(ns < 16) return (size_t)ns;
+			const int e = 63 - __builtin_clzll(ns);
+			return (size_t)(e - 3) * 16 + ((ns >> (e - 4)) & 15);
+		}
+};
+
+/* raw records of a read with long classification time, whose name line is extended by the search statistics */
+class SlowRead {
+	public:
+		uint64_t ns = 0;
+		std::string record1;
+		std::string record2;
+		bool operator>(const SlowRead & other) const { return ns > other.ns; }
+};
+
+/* one index in cascade mode, reads that are unclassified or have a lower score than min_score are passed on to the next index */
+class CascadeStage {
+	public:
+		FMI * fmi = nullptr;
+		BWT * bwt = nullptr;
+		AlphabetStruct * astruct = nullptr;
+		double db_length = 0.0;
+		unsigned int min_score = 0; // minimum score (match length in MEM mode) for accepting the classification of a read
+		uint64_t num_passed = 0; // number of reads passed on to the next index
+};
 
 class Config {
 	public:
@@ -34,6 +127,10 @@ class Config {
 		size_t max_matches_SI = 20; // maximum number of best matches with same score, used for LCA and output
 		size_t max_match_ids = 20; // maximum number of ids to print, used for LCA and output
 		size_t max_match_acc = 20; // maximum number of accession numbers to print, used for LCA and output
+		IndexType repeat_cap = 0; // suffix intervals with more rows are repetitive and only this many rows are located, 0 = disabled
+		std::atomic<uint64_t> count_repetitive{0}; // number of repetitive intervals, summed over all threads
+		std::atomic<uint64_t> count_repetitive_cached{0}; // of which were found in the per-thread cache
+		std::atomic<uint64_t> count_deleted{0}; // number of located rows belonging to deleted database sequences
 
 		bool debug = false;
 		bool verbose = false;
@@ -41,20 +138,50 @@ class Config {
 		bool SEG = true;
 		bool input_is_protein = false;
 		unsigned int min_fragment_length = 11; // in MEM and Greedy modes
-		unsigned int mismatches = 3; // in Greedy mode
-		unsigned int min_score = 65; // in Greedy mode
+		unsigned int mismatches = 3; // in Greedy and BNB modes
+		unsigned int min_score = 65; // in Greedy and BNB modes
 		unsigned int seed_length = 7; // in Greedy mode
-		bool use_Evalue = true; // can only be used in Greedy mode
-		double min_Evalue = 0.01; // can only be used in Greedy mode
+		bool use_Evalue = true; // can only be used in Greedy and BNB modes
+		double min_Evalue = 0.01; // can only be used in Greedy and BNB modes
 		double db_length;
 
+		bool mmap_index = false; // load only BWT and FMI checkpoints into RAM and map the suffix array from the index file
+
 		SegParameters * blast_seg_params;
 
 		std::ostream * out_stream;
+		std::vector<std::ostream *> sample_streams; // per-sample output when demultiplexing, used instead of out_stream
+
+		size_t interleave = 16; // number of reads per thread whose suffix array lookups are interleaved, 1 = disabled
+		size_t reorder_batch = 0; // reads are dispatched in batches of this size sorted by minimizer, 0 = in file order
+		std::map<uint64_t,ReadBatch> read_batches; // batches with output not written yet, guarded by ConsumerThread::output_mutex
+		uint64_t next_batch = 0; // next batch to be written to out_stream
 		std::unordered_map<uint64_t,uint64_t> * nodes;
 
+		std::vector<TaxonBin> taxon_bins; // per-taxon output of raw read records, empty if not used
+		std::unordered_map<uint64_t,std::pair<uint32_t,uint32_t>> node2interval; // only filled when using taxon_bins
+
+		unsigned int profile_sample = 0; // profile locating every n-th suffix array interval, 0 = disabled
+		std::unordered_map<int,SeqProfile> seq_profile; // database sequence number -> accumulated cost
+		std::mutex profile_mutex;
+
+		size_t num_slow_reads = 0; // number of reads with the longest classification time to keep, 0 = not measuring time
+		std::vector<SlowRead> slow_reads; // merged from all threads, guarded by ConsumerThread::output_mutex
+		LatencyHistogram latency; // classification time of all reads, guarded by ConsumerThread::output_mutex
+
+		std::ostream * trace_stream = nullptr; // trace file for sampled reads, nullptr = tracing disabled
+		unsigned int trace_sample = 0; // trace a pseudo-random sample of one in n reads, 0 = only reads in trace_reads
+		std::unordered_set<std::string> trace_reads; // names of reads that are always traced
+
 		FMI * fmi;
 		BWT * bwt;
+		std::vector<CascadeStage> cascade; // all indexes in the order of classification, empty when using only one index
+
+		// delta index with sequences added after building the main index, which is searched in addition to the main index
+		FMI * delta_fmi = nullptr;
+		BWT * delta_bwt = nullptr;
+		AlphabetStruct * delta_astruct = nullptr;
+		std::vector<bool> deleted; // database sequence numbers of the main index whose matches are ignored, empty if none
 
 		AlphabetStruct * astruct;
 
@@ -3,10 +3,27 @@
 
 #include "ConsumerThread.hpp"
 
-ConsumerThread::ConsumerThread(ProducerConsumerQueue<ReadItem*>* workQueue, Config * config) {
+ConsumerThread::ConsumerThread(ProducerConsumerQueue<ReadItem*>* workQueue, Config * config, size_t stage, ProducerConsumerQueue<ReadItem*>* nextQueue) {
 
 	myWorkQueue = workQueue;
 	this->config = config;
+	this->stage = stage;
+	this->nextQueue = nextQueue;
+	if(config->cascade.empty()) {
+		fmi = config->fmi;
+		bwt = config->bwt;
+		astruct = config->astruct;
+		db_length = config->db_length;
+	}
+	else {
+		fmi = config->cascade[stage].fmi;
+		bwt = config->cascade[stage].bwt;
+		astruct = config->cascade[stage].astruct;
+		db_length = config->cascade[stage].db_length;
+	}
+	if(!config->deleted.empty()) deleted = &config->deleted;
+	lca_early_exit = !config->verbose; // the verbose output lists all ids up to max_match_ids
+	defer_locate = config->interleave > 1;
 	blosum_subst = {
 					{'A',{'S', 'V', 'T', 'G', 'C', 'P', 'M', 'K', 'L', 'I', 'E', 'Q', 'R', 'Y', 'F', 'H', 'D', 'N', 'W' }},
 					{'R',{'K', 'Q', 'H', 'E', 'N', 'T', 'S', 'M', 'A', 'Y', 'P', 'L', 'G', 'D', 'V', 'W', 'F', 'I', 'C' }},
@@ -184,6 +201,25 @@ ConsumerThread::ConsumerThread(ProducerConsumerQueue<ReadItem*>* workQueue, Conf
 	for(unsigned int i = 0; i<=5; i++) {
 		translations[i].reserve(1000);
 	}
+
+	if(config->mode == BNB) {
+		// BLOSUM62 scores and substitution order indexed by the letter codes of the index alphabet
+		bnb_alen = bwt->alen;
+		bnb_scores.assign(bnb_alen * bnb_alen, -4);
+		bnb_order.resize(bnb_alen);
+		for(int a = 1; a < bnb_alen; a++) {
+			uint8_t aa = (uint8_t)bwt->alphabet[a];
+			if(blosum_subst.count((char)aa) == 0) continue;
+			for(int b = 1; b < bnb_alen; b++) {
+				uint8_t bb = (uint8_t)bwt->alphabet[b];
+				if(blosum_subst.count((char)bb) == 0) continue;
+				bnb_scores[a * bnb_alen + b] = (a == b) ? blosum62diag[aa2int[aa]] : b62[aa2int[aa]][aa2int[bb]];
+				bnb_order[a].push_back((uchar)b);
+			}
+			std::stable_sort(bnb_order[a].begin(), bnb_order[a].end(), [&](uchar x, uchar y) {
+					return bnb_scores[a * bnb_alen + x] > bnb_scores[a * bnb_alen + y]; });
+		}
+	}
 }
 
 
@@ -201,7 +237,7 @@ void ConsumerThread::getAllFragmentsBits(const std::string & line) {
 			size_t index = count%3;
 			// finished one of the translations, so add it to fragments
 			if(translations[index].length() >= config->min_fragment_length) {
-				if(config->mode==GREEDY) {
+				if(config->mode!=MEM) {
 					unsigned int score = calcScore(translations[index]);
 					if(score >= config->min_score)
 						fragments.emplace(score,new Fragment(translations[index]));
@@ -219,7 +255,7 @@ void ConsumerThread::getAllFragmentsBits(const std::string & line) {
 	for(unsigned int i = 0; i<=2; i++) {
 		//add remaining stuff to fragments
 		if(translations[i].length() >= config->min_fragment_length) {
-			if(config->mode==GREEDY) {
+			if(config->mode!=MEM) {
 				unsigned int score = calcScore(translations[i]);
 				if(score >= config->min_score)
 					fragments.emplace(score,new Fragment(translations[i]));
@@ -238,7 +274,7 @@ void ConsumerThread::getAllFragmentsBits(const std::string & line) {
 			size_t index = count%3;
 			// finished one of the translations, so add it to fragments
 			if(translations[index].length() >= config->min_fragment_length) {
-				if(config->mode==GREEDY) {
+				if(config->mode!=MEM) {
 					unsigned int score = calcScore(translations[index]);
 					if(score >= config->min_score)
 						fragments.emplace(score,new Fragment(translations[index]));
@@ -256,7 +292,7 @@ void ConsumerThread::getAllFragmentsBits(const std::string & line) {
 	for(unsigned int i = 0; i<=2; i++) {
 		//add remaining stuff to fragments
 		if(translations[i].length() >= config->min_fragment_length) {
-			if(config->mode==GREEDY) {
+			if(config->mode!=MEM) {
 				unsigned int score = calcScore(translations[i]);
 				if(score >= config->min_score)
 					fragments.emplace(score,new Fragment(translations[i]));
@@ -269,6 +305,53 @@ void ConsumerThread::getAllFragmentsBits(const std::string & line) {
 
 }
 
+/* Runs SEG on the fragment and, if low complexity regions are found, adds the pieces between them that are long enough
+ * and pass the score threshold to fragments and returns true, then the fragment itself is to be deleted by the caller. */
+bool ConsumerThread::split_SEG(Fragment * f) {
+	std::string convertedseq = f->seq;
+	for(size_t i = 0; i < convertedseq.length(); i++) {
+		convertedseq[i] = AMINOACID_TO_NCBISTDAA[(int)convertedseq[i]];
+	}
+	BlastSeqLoc *seg_locs = NULL;
+	SeqBufferSeg((Uint1*)(convertedseq.data()), (Int4)convertedseq.length(), 0, config->blast_seg_params, &seg_locs);
+	if(!seg_locs) { // no SEG regions found
+		return false;
+	}
+	BlastSeqLoc * curr_loc = seg_locs;
+	size_t start = 0; //start of non-SEGged piece
+	do {
+		size_t length = curr_loc->ssr->left - start;
+		if(config->debug) std::cerr << "SEG region: " << curr_loc->ssr->left << " - " << curr_loc->ssr->right << " = " << f->seq.substr(curr_loc->ssr->left,curr_loc->ssr->right - curr_loc->ssr->left + 1) << std::endl;
+		if(trace) trace->event("seg") << ",\"seq\":\"" << f->seq << "\",\"left\":" << curr_loc->ssr->left << ",\"right\":" << curr_loc->ssr->right;
+		if(length > config->min_fragment_length) {
+			if(config->mode != MEM) {
+				unsigned int score = calcScore(f->seq,start,length,0);
+				if(score >= config->min_score) {
+					fragments.emplace(score,new Fragment(f->seq.substr(start,length),true));
+				}
+			}
+			else {
+				fragments.emplace(length,new Fragment(f->seq.substr(start,length),true));
+			}
+		}
+		start = curr_loc->ssr->right + 1;
+	} while((curr_loc=curr_loc->next) != NULL);
+	size_t len_last_piece = f->seq.length() - start;
+	if(len_last_piece > config->min_fragment_length) {
+		if(config->mode != MEM) {
+			unsigned int score = calcScore(f->seq,start,len_last_piece,0);
+			if(score >= config->min_score) {
+				fragments.emplace(score,new Fragment(f->seq.substr(start,len_last_piece),true));
+			}
+		}
+		else {
+			fragments.emplace(len_last_piece,new Fragment(f->seq.substr(start,len_last_piece),true));
+		}
+	}
+	BlastSeqLocFree(seg_locs);
+	return true;
+}
+
 Fragment * ConsumerThread::getNextFragment(unsigned int min_score) {
 	if(fragments.empty()) {
 		return NULL;
@@ -283,61 +366,22 @@ Fragment * ConsumerThread::getNextFragment(unsigned int min_score) {
 	fragments.erase(it);
 
 	while(config->SEG && f != NULL && !f->SEGchecked) {
-		std::string convertedseq = f->seq;
-		for(size_t i = 0; i < convertedseq.length(); i++) {
-			convertedseq[i] = AMINOACID_TO_NCBISTDAA[(int)convertedseq[i]];
-		}
-		BlastSeqLoc *seg_locs = NULL;
-		SeqBufferSeg((Uint1*)(convertedseq.data()), (Int4)convertedseq.length(), 0, config->blast_seg_params, &seg_locs);
-		if(seg_locs) { // SEG found region(s)
-			BlastSeqLoc * curr_loc = seg_locs;
-			size_t start = 0; //start of non-SEGged piece
-			do {
-				size_t length = curr_loc->ssr->left - start;
-				if(config->debug) std::cerr << "SEG region: " << curr_loc->ssr->left << " - " << curr_loc->ssr->right << " = " << f->seq.substr(curr_loc->ssr->left,curr_loc->ssr->right - curr_loc->ssr->left + 1) << std::endl;
-				if(length > config->min_fragment_length) {
-					if(config->mode == GREEDY) {
-						unsigned int score = calcScore(f->seq,start,length,0);
-						if(score >= config->min_score) {
-							fragments.emplace(score,new Fragment(f->seq.substr(start,length),true));
-						}
-					}
-					else {
-						fragments.emplace(length,new Fragment(f->seq.substr(start,length),true));
-					}
-				}
-				start = curr_loc->ssr->right + 1;
-			} while((curr_loc=curr_loc->next) != NULL);
-			size_t len_last_piece = f->seq.length() - start;
-			if(len_last_piece > config->min_fragment_length) {
-				if(config->mode == GREEDY) {
-					unsigned int score = calcScore(f->seq,start,len_last_piece,0);
-					if(score >= config->min_score) {
-						fragments.emplace(score,new Fragment(f->seq.substr(start,len_last_piece),true));
-					}
-				}
-				else {
-					fragments.emplace(len_last_piece,new Fragment(f->seq.substr(start,len_last_piece),true));
-				}
-			}
-
-			BlastSeqLocFree(seg_locs);
-			delete f;
-			f = NULL;
-			if(!fragments.empty()) {
-				it = fragments.begin();
-				if(it->first >= min_score) {
-					f = it->second;
-					fragments.erase(it);
-					// next iteration of while loop
-				}
-			}
+		if(!split_SEG(f)) { // no SEG regions found
+			break;
 		}
-		else { // no SEG regions found
-			return f;
+		delete f;
+		f = NULL;
+		if(!fragments.empty()) {
+			it = fragments.begin();
+			if(it->first >= min_score) {
+				f = it->second;
+				fragments.erase(it);
+				// next iteration of while loop
+			}
 		}
 	}
 
+	if(f != NULL) read_num_searched++;
 	return f;
 }
 
@@ -364,6 +408,7 @@ void ConsumerThread::addAllMismatchVariantsAtPosSI(const Fragment * f, unsigned
 	IndexType siarray[2], siarrayupd[2];
 	siarray[0] = si->start;
 	siarray[1] = si->start+(IndexType)si->len;
+	unsigned int num_added = 0;
 
 	for(auto itv : blosum_subst.at(origchar)) {
 		// we know the difference between score of original aa and substitution score, this
@@ -371,11 +416,12 @@ void ConsumerThread::addAllMismatchVariantsAtPosSI(const Fragment * f, unsigned
 		// so we add this difference to the fragment
 		int score_after_subst = score + b62[aa2int[(uint8_t)origchar]][aa2int[(uint8_t)itv]];
 		if(score_after_subst >= (int)best_match_score && score_after_subst >= (int)config->min_score) {
-			if(UpdateSI(config->fmi, config->astruct->trans[(size_t)itv], siarray, siarrayupd) != 0) {
+			if(UpdateSI(fmi, astruct->trans[(size_t)itv], siarray, siarrayupd) != 0) {
 				fragment[pos] = itv;
 				int diff = b62[aa2int[(uint8_t)origchar]][aa2int[(uint8_t)itv]] - blosum62diag[aa2int[(uint8_t)itv]];
 				if(config->debug) std::cerr << "Adding fragment   " << fragment << " with mismatch at pos " << pos << " ,diff " << f->diff+diff << ", max score " << score_after_subst << "\n";
 				fragments.emplace(score_after_subst,new Fragment(fragment,f->num_mm+1, pos, f->diff + diff,siarrayupd[0],siarrayupd[1],si->ql+1));
+				num_added++;
 			}
 			else if(config->debug) {
 				fragment[pos] = itv;
@@ -391,6 +437,7 @@ void ConsumerThread::addAllMismatchVariantsAtPosSI(const Fragment * f, unsigned
 			break;
 		}
 	}
+	if(trace) trace->event("mismatch") << ",\"pos\":" << pos << ",\"added\":" << num_added;
 
 }
 
@@ -421,6 +468,23 @@ unsigned int ConsumerThread::calcScore(const std::string & s) {
 }
 
 
+/* returns the fragment translated into letter codes for the search, which has to be deleted by the caller */
+char * ConsumerThread::fragment_codes(const Fragment * t) {
+	const size_t length = t->seq.length();
+	if(config->mode == MEM) {
+		if(config->debug) { std::cerr << "Searching fragment "<< t->seq <<  " (" << length << ")" << "\n"; }
+		if(trace) trace->event("search") << ",\"seq\":\"" << t->seq << "\"";
+	}
+	else {
+		if(config->debug) { std::cerr << "Searching fragment "<< t->seq <<  " (" << length << ","<< t->num_mm << "," << t->diff << ")" << "\n"; }
+		if(trace) trace->event("search") << ",\"seq\":\"" << t->seq << "\",\"num_mm\":" << t->num_mm << ",\"diff\":" << t->diff;
+	}
+	char * seq = new char[length+1];
+	std::strcpy(seq, t->seq.c_str());
+	translate2numbers((uchar *)seq, (unsigned int)length, astruct);
+	return seq;
+}
+
 uint64_t ConsumerThread::classify_greedyblosum() {
 
 		best_matches_SI.clear();
@@ -430,37 +494,40 @@ uint64_t ConsumerThread::classify_greedyblosum() {
 		while(1) {
 			Fragment * t = getNextFragment(best_match_score);
 			if(!t) break;
-			const std::string fragment = t->seq;
-			const size_t length = fragment.length();
-			const unsigned int num_mm = t->num_mm;
-
-			if(config->debug) { std::cerr << "Searching fragment "<< fragment <<  " (" << length << ","<< num_mm << "," << t->diff << ")" << "\n"; }
-			char * seq = new char[length+1];
-			std::strcpy(seq, fragment.c_str());
-
-			translate2numbers((uchar *)seq, (unsigned int)length, config->astruct);
+			const unsigned int length = (unsigned int)t->seq.length();
+			char * seq = fragment_codes(t);
 
 			SI * si = NULL;
-			if(num_mm > 0) {
-				if(num_mm == config->mismatches) { //after last mm has been done, we need to have at least reached the min_length
-					si = maxMatches_withStart(config->fmi, seq, (unsigned int)length, config->min_fragment_length, 1,t->si0,t->si1,t->matchlen);
-				}
-				else {
-					si = maxMatches_withStart(config->fmi, seq, (unsigned int)length, t->matchlen, 1,t->si0,t->si1,t->matchlen);
-				}
-
+			if(t->num_mm > 0) {
+				//after last mm has been done, we need to have at least reached the min_length
+				const int min_length = (t->num_mm == config->mismatches) ? (int)config->min_fragment_length : t->matchlen;
+				si = maxMatches_withStart(fmi, seq, length, min_length, 1,t->si0,t->si1,t->matchlen);
 			}
 			else {
-				si = maxMatches(config->fmi, seq, (unsigned int)length, config->seed_length, 0); //initial matches
+				si = maxMatches(fmi, seq, length, config->seed_length, 0); //initial matches
 			}
+			greedy_fragment_matches(t, seq, si);
+
+		} // end current fragment
+
+		return lca_from_best_matches();
+}
+
+/* adds the mismatch variants of the searched fragment t and keeps its best matches si, then deletes t and seq */
+void ConsumerThread::greedy_fragment_matches(Fragment * t, char * seq, SI * si) {
+			const std::string & fragment = t->seq;
+			const size_t length = fragment.length();
+			const unsigned int num_mm = t->num_mm;
 
 			if(!si) {// no match for this fragment
 				if(config->debug) std::cerr << "No match for this fragment." << "\n";
+				if(trace) trace->event("no_match");
 				delete[] seq;
 				delete t;
-				continue; // continue with the next fragment
+				return; // continue with the next fragment
 			}
 			if(config->debug) std::cerr << "Longest match is length " << (unsigned int)si->ql <<  "\n";
+			if(trace) trace_SI(si);
 
 			if(config->mismatches > 0 && num_mm < config->mismatches) {
 				SI * si_it = si;
@@ -484,15 +551,173 @@ uint64_t ConsumerThread::classify_greedyblosum() {
 				delete[] seq;
 				delete t;
 				recursive_free_SI(si);
-				continue; // continue with the next fragment
+				return; // continue with the next fragment
 			}
 
 			eval_match_scores(si, t);
 			delete[] seq;
 			delete t;
+}
+
+/* branch-and-bound search for the best ungapped BLOSUM62 match of each fragment, exploring
+ * all substitutions (up to config->mismatches) by a depth-first search in the FM-index.
+ * A branch is cut when even an exact match of the whole remaining fragment to the left
+ * cannot reach the score of the best match found so far or min_score. */
+uint64_t ConsumerThread::classify_bnb() {
+
+		best_matches_SI.clear();
+		best_matches.clear();
+		best_match_score = 0;
+
+		bnb_min_score = (int)config->min_score;
+		if(config->use_Evalue) {
+			// matches scoring below the E-value cutoff would be discarded anyway
+			double bitscore = log2(db_length * query_len / config->min_Evalue);
+			int s = std::max(0, (int)floor((bitscore * LN_2 + LN_K) / LAMBDA));
+			while(db_length * query_len * pow(2, -1 * (LAMBDA * s - LN_K) / LN_2) > config->min_Evalue) s++;
+			bnb_min_score = std::max(bnb_min_score, s);
+		}
+
+		while(1) {
+			Fragment * t = getNextFragment(best_match_score);
+			if(!t) break;
+			const std::string fragment = t->seq;
+			const int length = (int)fragment.length();
+
+			if(config->debug) { std::cerr << "Searching fragment "<< fragment <<  " (" << length << ")" << "\n"; }
+			if(trace) trace->event("search") << ",\"seq\":\"" << fragment << "\"";
+			bnb_query.assign(fragment.begin(), fragment.end());
+			translate2numbers((uchar *)bnb_query.data(), (unsigned int)length, astruct);
+
+			// bnb_prefix[i] is the score of an exact match of q[0..i], which is the maximum score of any match ending in i
+			bnb_prefix.resize(length);
+			int sum = 0;
+			for(int i = 0; i < length; i++) {
+				sum += bnb_scores[bnb_query[i] * bnb_alen + bnb_query[i]];
+				bnb_prefix[i] = sum;
+			}
+			bnb_path.resize(length);
+			bnb_occ.resize(2 * bnb_alen * length);
+
+			// the best exact match gives a lower bound for the score before branching
+			bnb_lower = 0;
+			for(int j = length - 1; j >= (int)config->min_fragment_length - 1; j--) {
+				if(bnb_prefix[j] <= bnb_lower) break;
+				IndexType si[2], nsi[2];
+				InitialSI(fmi, bnb_query[j], si);
+				int i = j - 1;
+				while(si[1] > si[0] && i >= 0 && UpdateSI(fmi, bnb_query[i], si, nsi) != 0) {
+					si[0] = nsi[0]; si[1] = nsi[1];
+					i--;
+				}
+				if(j - i >= (int)config->min_fragment_length)
+					bnb_lower = std::max(bnb_lower, bnb_prefix[j] - (i >= 0 ? bnb_prefix[i] : 0));
+			}
+
+			for(int j = length - 1; j >= (int)config->min_fragment_length - 1; j--) {
+				if(bnb_prefix[j] < bnb_threshold()) break; // prefix sums decrease with j
+				const uchar q = bnb_query[j];
+				for(const uchar c : bnb_order[q]) {
+					const int score = bnb_scores[q * bnb_alen + c];
+					if(score + (j > 0 ? bnb_prefix[j-1] : 0) < bnb_threshold()) break; // letters are sorted by decreasing score
+					const unsigned int num_mm = (c != q) ? 1 : 0;
+					if(num_mm > config->mismatches) continue;
+					IndexType si[2];
+					InitialSI(fmi, c, si);
+					if(si[1] <= si[0]) continue;
+					bnb_path[j] = c;
+					bnb_extend(j - 1, j, si, score, 0, num_mm);
+				}
+			}
+			delete t;
 
 		} // end current fragment
 
+		return lca_from_best_matches();
+}
+
+/* the match q[i+1..j] with suffix interval si and given score is extended by all letters at position i */
+void ConsumerThread::bnb_extend(int i, int j, IndexType * si, int score, int best_on_path, unsigned int num_mm) {
+
+	const int len = j - i;
+	if(len >= (int)config->min_fragment_length && score > best_on_path) {
+		// only record a match if it scores higher than all shorter matches on the same path
+		bnb_record(si, i + 1, len, score);
+		best_on_path = score;
+	}
+	if(i < 0) return;
+
+	const uchar q = bnb_query[i];
+	const int bound = (i > 0) ? bnb_prefix[i-1] : 0;
+	if(score <= 0) {
+		// any extension is dominated by the same match without q[i+1..j], which is found from right end i,
+		// unless that one would be shorter than min_fragment_length
+		const int k = i + 1 - (int)config->min_fragment_length;
+		if(score + bnb_prefix[i] - (k >= 0 ? bnb_prefix[k] : 0) < bnb_threshold()) return;
+	}
+	if(num_mm >= config->mismatches) {
+		// no substitutions left, only the exact extension
+		IndexType nsi[2];
+		if(score + bnb_scores[q * bnb_alen + q] + bound < bnb_threshold()) return;
+		if(UpdateSI(fmi, q, si, nsi) == 0) return;
+		bnb_path[i] = q;
+		bnb_extend(i - 1, j, nsi, score + bnb_scores[q * bnb_alen + q], best_on_path, num_mm);
+		return;
+	}
+	// the suffix intervals of all extensions by one letter at once
+	IndexType * lo = &bnb_occ[2 * bnb_alen * i];
+	IndexType * hi = lo + bnb_alen;
+	FMindexAll(fmi, si[0], lo);
+	FMindexAll(fmi, si[1], hi);
+	for(const uchar c : bnb_order[q]) {
+		const int s = bnb_scores[q * bnb_alen + c];
+		if(score + s + bound < bnb_threshold()) break; // letters are sorted by decreasing score
+		if(lo[c] >= hi[c]) continue;
+		IndexType nsi[2] = { lo[c], hi[c] };
+		bnb_path[i] = c;
+		bnb_extend(i - 1, j, nsi, score + s, best_on_path, num_mm + ((c != q) ? 1 : 0));
+	}
+}
+
+void ConsumerThread::bnb_record(IndexType * si, int qi, int ql, int score) {
+	if(score < bnb_min_score || score < (int)best_match_score) return;
+	if(score == (int)best_match_score && best_matches_SI.size() >= config->max_matches_SI) return;
+	if(score > (int)best_match_score) {
+		for(auto itm : best_matches_SI) {
+			free(itm);
+		}
+		best_matches_SI.clear();
+		best_matches.clear();
+		best_match_score = (unsigned int)score;
+	}
+	SI * match = (SI *)malloc(sizeof(SI));
+	match->start = si[0];
+	match->len = (int)(si[1] - si[0]);
+	match->qi = qi;
+	match->ql = ql;
+	match->count = 0;
+	match->score = score;
+	match->next = NULL;
+	match->samelen = NULL;
+	best_matches_SI.push_back(match);
+	if(config->verbose) {
+		std::string m(ql, ' ');
+		for(int k = 0; k < ql; k++) m[k] = bwt->alphabet[bnb_path[qi + k]];
+		best_matches.push_back(m);
+	}
+	if(config->debug) std::cerr << "Match at " << qi << " (length=" << ql << " score=" << score << ")\n";
+	if(trace) trace->event("match") << ",\"ql\":" << ql << ",\"score\":" << score << ",\"rows\":" << (si[1] - si[0]);
+}
+
+/* minimum score of a match that can still change the result */
+inline int ConsumerThread::bnb_threshold() {
+	int t = (int)best_match_score;
+	if(!best_matches_SI.empty() && best_matches_SI.size() >= config->max_matches_SI) t++;
+	return std::max(std::max(t, bnb_lower), bnb_min_score);
+}
+
+uint64_t ConsumerThread::lca_from_best_matches() {
+
 		if(best_matches_SI.empty()) {
 			return 0;
 		}
@@ -501,7 +726,7 @@ uint64_t ConsumerThread::classify_greedyblosum() {
 			//calc e-value and only return match if > cutoff
 
 			double bitscore = (LAMBDA * best_match_score - LN_K) / LN_2;
-			double Evalue = config->db_length * query_len * pow(2, -1 * bitscore);
+			double Evalue = db_length * query_len * pow(2, -1 * bitscore);
 			if(config->debug) std::cerr << "E-value = " << Evalue << std::endl;
 
 			if(Evalue > config->min_Evalue) {
@@ -512,8 +737,24 @@ uint64_t ConsumerThread::classify_greedyblosum() {
 			}
 		}
 
+		if(defer_locate && trace == nullptr) {
+			PendingRead & p = *deferred_read;
+			p.locate = true;
+			p.score = best_match_score;
+			for(auto itm : best_matches_SI) {
+				if(config->repeat_cap > 0 && (IndexType)itm->len > config->repeat_cap)
+					ids_from_repetitive(itm->start, (IndexType)itm->len, p.match_ids, p.match_dbnames, p.match_lca);
+				else
+					p.intervals.emplace_back(itm->start, (IndexType)itm->len);
+				free(itm);
+			}
+			if(config->verbose) p.matches.swap(best_matches);
+			return 0;
+		}
+
 		match_ids.clear();
 		match_dbnames.clear();
+		match_lca = PartialLCA();
 
 		for(auto itm : best_matches_SI) {
 			ids_from_SI(itm);
@@ -542,35 +783,40 @@ uint64_t ConsumerThread::classify_greedyblosum() {
 
 uint64_t ConsumerThread::classify_length() {
 
-		unsigned int longest_match_length = 0;
+		longest_match_length = 0;
 		longest_matches_SI.clear();
 		longest_fragments.clear();
 
 		while(1) {
 			Fragment * t = getNextFragment(longest_match_length);
 			if(!t) break;// searched all fragments that are longer than best match length
-			const std::string fragment = t->seq;
-			const size_t length = fragment.length();
+			char * seq = fragment_codes(t);
+			//use longest_match_length here too:
+			//SI * si = maxMatches(fmi, seq, length, max(config->min_fragment_length,longest_match_length),  1);
+			SI * si = greedyExact(fmi, seq, (unsigned int)t->seq.length(), std::max(config->min_fragment_length,longest_match_length),  -1);
+			length_fragment_matches(t, seq, si);
 
-			if(config->debug) { std::cerr << "Searching fragment "<< fragment <<  " (" << length << ")" << "\n"; }
-			char * seq = new char[length+1];
-			std::strcpy(seq, fragment.c_str());
+		} // end current fragment
 
-			translate2numbers((uchar *)seq, (unsigned int)length, config->astruct);
-			//use longest_match_length here too:
-			//SI * si = maxMatches(config->fmi, seq, length, max(config->min_fragment_length,longest_match_length),  1);
-			SI * si = greedyExact(config->fmi, seq, (unsigned int)length, std::max(config->min_fragment_length,longest_match_length),  -1);
+		return lca_from_longest_matches();
+}
+
+/* keeps the matches si of the searched fragment t if they are the longest so far, then deletes t and seq */
+void ConsumerThread::length_fragment_matches(Fragment * t, char * seq, SI * si) {
+			const std::string & fragment = t->seq;
 
 			if(!si) {// no match for this fragment
 				if(config->debug) std::cerr << "No match for this fragment." << "\n";
+				if(trace) trace->event("no_match");
 				delete[] seq;
 				delete t;
-				continue; // continue with the next fragment
+				return; // continue with the next fragment
 			}
 
 
 			// just get length here and save si when it is longest
 			if(config->debug) std::cerr << "Longest match is length " << (unsigned int)si->ql << "\n";
+			if(trace) trace_SI(si);
 			if((unsigned int)si->ql > longest_match_length) {
 				for(auto itm : longest_matches_SI) {
 					recursive_free_SI(itm);
@@ -595,14 +841,33 @@ uint64_t ConsumerThread::classify_length() {
 			}
 			delete[] seq;
 			delete t;
+}
 
-		} // end current fragment
+uint64_t ConsumerThread::lca_from_longest_matches() {
 
+		read_score = longest_match_length;
 		if(longest_matches_SI.empty()) {
 			return 0;
 		}
+		if(defer_locate && trace == nullptr) {
+			PendingRead & p = *deferred_read;
+			p.locate = true;
+			p.score = longest_match_length;
+			for(auto itm : longest_matches_SI) {
+				for(SI * si_it = itm; si_it; si_it = si_it->samelen) {
+					if(config->repeat_cap > 0 && (IndexType)si_it->len > config->repeat_cap)
+						ids_from_repetitive(si_it->start, (IndexType)si_it->len, p.match_ids, p.match_dbnames, p.match_lca);
+					else
+						p.intervals.emplace_back(si_it->start, (IndexType)si_it->len);
+				}
+				recursive_free_SI(itm);
+			}
+			if(config->verbose) p.matches.swap(longest_fragments);
+			return 0;
+		}
 		match_ids.clear();
 		match_dbnames.clear();
+		match_lca = PartialLCA();
 		for(auto itm : longest_matches_SI) {
 			ids_from_SI_recursive(itm);
 		}
@@ -629,6 +894,10 @@ uint64_t ConsumerThread::classify_length() {
 
 void ConsumerThread::doWork() {
 	ReadItem * item = NULL;
+	bin_output1.resize(config->taxon_bins.size());
+	bin_output2.resize(config->taxon_bins.size());
+	bin_counts.assign(config->taxon_bins.size(), 0);
+	sample_output.resize(config->sample_streams.size());
 	while(myWorkQueue->pop(&item)) {
 		assert(item != NULL);
 		read_count++;
@@ -636,54 +905,82 @@ void ConsumerThread::doWork() {
 			flush_output();
 			read_count = 0;
 		}
-
-		if(config->input_is_protein) {
-			if(item->sequence1.length() < config->min_fragment_length) {
-				output << "U\t" << item->name << "\t0\n";
-				delete item;
-				continue;
+		if(config->interleave > 1) {
+			// searching and locating the matches of the read is deferred until the window of pending reads is full
+			pending.emplace_back(item);
+			if(!start_pending_search(pending.back())) {
+				deferred_read = &pending.back();
+				uint64_t lca = classify_read(item);
+				pending.back().score = read_score;
+				if(!pending.back().locate) {
+					pending.back().lca = lca;
+					pending.back().extraoutput.swap(extraoutput);
+				}
 			}
+			if(pending.size() >= config->interleave) {
+				search_pending();
+				locate_pending();
+			}
+		}
+		else if(config->num_slow_reads > 0) {
+			std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+			uint64_t lca = classify_read(item);
+			record_latency(item, lca, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_start).count());
+			write_result(item, lca, extraoutput, read_score);
 		}
 		else {
-			if((!item->paired && item->sequence1.length() < config->min_fragment_length*3) ||
-				(item->paired && item->sequence1.length() < config->min_fragment_length*3 && item->sequence2.length() < config->min_fragment_length*3)) {
-				output << "U\t" << item->name << "\t0\n";
-				delete item;
-				continue;
-			}
+			uint64_t lca = classify_read(item);
+			write_result(item, lca, extraoutput, read_score);
 		}
+	}
+	search_pending();
+	locate_pending();
 
-		uint64_t lca = 0;
-		extraoutput = "";
+	flush_output();
+	if(nextQueue != nullptr) {
+		std::lock_guard<std::mutex> out_lock(output_mutex);
+		config->cascade[stage].num_passed += num_passed;
+	}
+	if(config->num_slow_reads > 0) {
+		std::lock_guard<std::mutex> out_lock(output_mutex);
+		config->latency.merge(latency);
+		for(auto & r : slow_reads) config->slow_reads.push_back(std::move(r));
+		slow_reads.clear();
+	}
 
-		if(config->input_is_protein) {
-			query_len = static_cast<double>(item->sequence1.length());
-			for (auto & c: item->sequence1) {
-				c = (char)toupper(c);
-			}
-			size_t start = 0;
-			size_t pos = item->sequence1.find_first_not_of("ACDEFGHIKLMNPQRSTVWY");
-			while(pos != std::string::npos) {
-				if(pos-start >= config->min_fragment_length) {
-					std::string subseq =  item->sequence1.substr(start,pos-start);
-					//std::cerr << "subseq=" << subseq << endl;
-					if(config->mode==GREEDY) {
-						unsigned int score = calcScore(subseq);
-						if(score >= config->min_score) {
-							fragments.emplace(score,new Fragment(subseq));
-						}
-					}
-					else {
-						fragments.emplace((unsigned int)subseq.length(),new Fragment(subseq));
-					}
-				}
-				start = pos+1;
-				pos = item->sequence1.find_first_not_of("ACDEFGHIKLMNPQRSTVWY", pos + 1);
-			}
-			//add remaining sequence, which corresponds to the whole sequence if no invalid char was found
-			std::string subseq = item->sequence1.substr(start,item->sequence1.length()-start);
-			if(subseq.length() >= config->min_fragment_length) {
-				if(config->mode==GREEDY) {
+	if(config->profile_sample > 0) merge_profile();
+	config->count_repetitive += count_repetitive;
+	config->count_repetitive_cached += count_repetitive_cached;
+	config->count_deleted += count_deleted;
+
+}
+
+/* adds the fragments of the translated read to fragments and sets query_len, returns false if the read is too short */
+bool ConsumerThread::translate_read(ReadItem * item) {
+	if(config->input_is_protein) {
+		if(item->sequence1.length() < config->min_fragment_length) {
+			return false;
+		}
+	}
+	else {
+		if((!item->paired && item->sequence1.length() < config->min_fragment_length*3) ||
+			(item->paired && item->sequence1.length() < config->min_fragment_length*3 && item->sequence2.length() < config->min_fragment_length*3)) {
+			return false;
+		}
+	}
+
+	if(config->input_is_protein) {
+		query_len = static_cast<double>(item->sequence1.length());
+		for (auto & c: item->sequence1) {
+			c = (char)toupper(c);
+		}
+		size_t start = 0;
+		size_t pos = item->sequence1.find_first_not_of("ACDEFGHIKLMNPQRSTVWY");
+		while(pos != std::string::npos) {
+			if(pos-start >= config->min_fragment_length) {
+				std::string subseq =  item->sequence1.substr(start,pos-start);
+				//std::cerr << "subseq=" << subseq << endl;
+				if(config->mode!=MEM) {
 					unsigned int score = calcScore(subseq);
 					if(score >= config->min_score) {
 						fragments.emplace(score,new Fragment(subseq));
@@ -693,59 +990,412 @@ void ConsumerThread::doWork() {
 					fragments.emplace((unsigned int)subseq.length(),new Fragment(subseq));
 				}
 			}
+			start = pos+1;
+			pos = item->sequence1.find_first_not_of("ACDEFGHIKLMNPQRSTVWY", pos + 1);
 		}
-		else { // normal mode with DNA input
-			query_len = static_cast<double>(item->sequence1.length()) / 3.0;
-			if(item->sequence1.length() >= config->min_fragment_length*3) {
-				if(config->debug) std::cerr << "Getting fragments for read: "<< item->sequence1 << "\n";
-				getAllFragmentsBits(item->sequence1);
-			}
-			if(item->paired) {
-				query_len += static_cast<double>(item->sequence2.length()) / 3.0;
-				if(item->sequence2.length() >= config->min_fragment_length*3) {
-					if(config->debug) std::cerr << "Getting fragments for 2nd read: " << item->sequence2 << "\n";
-					getAllFragmentsBits(item->sequence2);
+		//add remaining sequence, which corresponds to the whole sequence if no invalid char was found
+		std::string subseq = item->sequence1.substr(start,item->sequence1.length()-start);
+		if(subseq.length() >= config->min_fragment_length) {
+			if(config->mode!=MEM) {
+				unsigned int score = calcScore(subseq);
+				if(score >= config->min_score) {
+					fragments.emplace(score,new Fragment(subseq));
 				}
 			}
+			else {
+				fragments.emplace((unsigned int)subseq.length(),new Fragment(subseq));
+			}
+		}
+	}
+	else { // normal mode with DNA input
+		query_len = static_cast<double>(item->sequence1.length()) / 3.0;
+		if(item->sequence1.length() >= config->min_fragment_length*3) {
+			if(config->debug) std::cerr << "Getting fragments for read: "<< item->sequence1 << "\n";
+			getAllFragmentsBits(item->sequence1);
+		}
+		if(item->paired) {
+			query_len += static_cast<double>(item->sequence2.length()) / 3.0;
+			if(item->sequence2.length() >= config->min_fragment_length*3) {
+				if(config->debug) std::cerr << "Getting fragments for 2nd read: " << item->sequence2 << "\n";
+				getAllFragmentsBits(item->sequence2);
+			}
+		}
+	}
+	return true;
+}
+
+/* Runs one stage of the classification pipeline on the batches of reads from in_queue and passes them on to out_queue.
+ * The stages are the translation of the reads with SEG, the search of the fragments in the index, locating the matches
+ * and determining the LCA, and writing the output. The number of threads can be set for each stage, such that more
+ * threads can be given to the memory-latency bound search and locate stages than to the CPU-bound other stages. */
+void ConsumerThread::doPipelineWork(PipelineStage pipeline_stage, ProducerConsumerQueue<PipelineBatch*>* in_queue, ProducerConsumerQueue<PipelineBatch*>* out_queue) {
+	PipelineBatch * batch = NULL;
+	bin_output1.resize(config->taxon_bins.size());
+	bin_output2.resize(config->taxon_bins.size());
+	bin_counts.assign(config->taxon_bins.size(), 0);
+	defer_locate = true;
+	while(in_queue->pop(&batch)) {
+		assert(batch != NULL);
+		if(pipeline_stage == TRANSLATE) {
+			translate_batch(batch);
+		}
+		else if(pipeline_stage == SEARCH) {
+			search_batch(batch);
+		}
+		else if(pipeline_stage == LOCATE) {
+			pending.swap(batch->reads);
+			locate_pending_matches();
+			pending.swap(batch->reads);
+		}
+		else {
+			read_count += (uint32_t)batch->reads.size();
+			pending.swap(batch->reads);
+			write_pending();
+			if(read_count > 20000) {
+				flush_output();
+				read_count = 0;
+			}
+		}
+		if(out_queue != nullptr) out_queue->push(batch);
+		else delete batch;
+	}
+
+	flush_output();
+	config->count_repetitive += count_repetitive;
+	config->count_repetitive_cached += count_repetitive_cached;
+	config->count_deleted += count_deleted;
+}
+
+/* translates the reads of the batch, the fragments are handed to the search stage,
+ * which runs SEG on them in getNextFragment() like the other modes */
+void ConsumerThread::translate_batch(PipelineBatch * batch) {
+	for(auto & p : batch->reads) {
+		translate_read(p.item);
+		p.query_len = query_len;
+		p.fragments.assign(fragments.begin(), fragments.end());
+		fragments.clear(); // the fragments are owned by p now
+	}
+}
+
+/* searches the fragments of the reads of the batch, locating the matches is deferred to the locate stage.
+ * In Greedy and MEM mode, the reads of the batch are searched together by search_pending(). */
+void ConsumerThread::search_batch(PipelineBatch * batch) {
+	pending.swap(batch->reads);
+	for(auto & p : pending) {
+		for(auto const & it : p.fragments) fragments.emplace(it.first, it.second);
+		p.fragments.clear();
+		query_len = p.query_len;
+		if(config->mode != BNB) {
+			p.search = new ReadSearch();
+			p.search->query_len = query_len;
+			p.search->fragments.swap(fragments);
+			continue;
 		}
+		deferred_read = &p;
+		read_score = 0;
+		extraoutput = "";
+		uint64_t lca = classify_fragments();
+		p.score = read_score;
+		if(!p.locate) {
+			p.lca = lca;
+			p.extraoutput.swap(extraoutput);
+		}
+		clearFragments();
+	}
+	search_pending();
+	batch->reads.swap(pending);
+	pending.clear();
+}
+
+/* Translates the read for searching it together with the other pending reads in search_pending(), which is done in
+ * Greedy and MEM mode, unless the read is traced or a delta index is used. Returns false if the read is classified right away. */
+bool ConsumerThread::start_pending_search(PendingRead & p) {
+	if(config->mode == BNB || config->delta_fmi != nullptr) return false;
+	if(config->trace_stream != nullptr && trace_read(p.item)) return false;
+	if(!translate_read(p.item)) {
+		clearFragments();
+		return true; // read is too short and remains unclassified
+	}
+	p.search = new ReadSearch();
+	p.search->query_len = query_len;
+	p.search->fragments.swap(fragments);
+	return true;
+}
 
-		if(config->debug) std::cerr << fragments.size()  << " fragments found in the read."<< "\n";
+/* swaps the search state of a pending read with the members used by classify_greedyblosum() and classify_length() */
+void ConsumerThread::swap_search(ReadSearch & r) {
+	fragments.swap(r.fragments);
+	std::swap(query_len, r.query_len);
+	if(config->mode == MEM) {
+		longest_matches_SI.swap(r.matches_SI);
+		longest_fragments.swap(r.matches);
+		std::swap(longest_match_length, r.score);
+	}
+	else {
+		best_matches_SI.swap(r.matches_SI);
+		best_matches.swap(r.matches);
+		std::swap(best_match_score, r.score);
+	}
+}
 
+/* Starts the search of the next fragment of the pending read, whose search state is swapped in.
+ * If all fragments are searched, the best matches are handed over for locating and false is returned. */
+bool ConsumerThread::next_pending_fragment(PendingRead & p) {
+	ReadSearch & r = *p.search;
+	Fragment * t = getNextFragment(config->mode == MEM ? longest_match_length : best_match_score);
+	if(t) {
+		r.fragment = t;
+		r.seq = fragment_codes(t);
+		const int length = (int)t->seq.length();
 		if(config->mode == MEM) {
-			lca = classify_length();
+			greedyExact_start(fmi, &r.match, r.seq, length, (int)std::max(config->min_fragment_length,longest_match_length), -1);
 		}
-		else if(config->mode == GREEDY) {
-			lca = classify_greedyblosum();
+		else if(t->num_mm > 0) {
+			const int min_length = (t->num_mm == config->mismatches) ? (int)config->min_fragment_length : t->matchlen;
+			maxMatches_withStart_start(fmi, &r.match, r.seq, length, min_length, t->si0, t->si1, t->matchlen);
 		}
-		else { // this should not happen
-			assert(false);
+		else {
+			maxMatches_start(fmi, &r.match, r.seq, length, (int)config->seed_length, 0);
 		}
+		return true;
+	}
+	clearFragments();
+	extraoutput = "";
+	deferred_read = &p;
+	uint64_t lca = (config->mode == MEM) ? lca_from_longest_matches() : lca_from_best_matches();
+	p.score = (config->mode == MEM) ? read_score : best_match_score;
+	if(!p.locate) {
+		p.lca = lca;
+		p.extraoutput.swap(extraoutput);
+	}
+	return false;
+}
 
-		if(lca > 0) {
-			output << "C\t" << item->name << "\t" << lca;
-			if(config->verbose) output << "\t" << extraoutput;
-			output << "\n";
-			if(config->debug) {
-				std::cerr << "C\t" << item->name << "\t" << lca << "\t" << extraoutput << "\n";
-			}
-
+/* Searches the fragments of all pending reads with a search state. The backward searches of the current fragments of
+ * the reads are extended by one letter in turn, and each step prefetches the FM index checkpoints of the next step, such
+ * that the memory accesses of the different reads overlap. The fragments of each read are searched in the same order and
+ * with the same cut-offs as in classify_greedyblosum() and classify_length(). */
+void ConsumerThread::search_pending() {
+	search_active.clear();
+	for(size_t r = 0; r < pending.size(); r++) {
+		PendingRead & p = pending[r];
+		if(p.search == nullptr) continue;
+		swap_search(*p.search);
+		const bool searching = next_pending_fragment(p);
+		swap_search(*p.search);
+		if(searching) search_active.push_back(r);
+		else {
+			delete p.search;
+			p.search = nullptr;
 		}
-		else  {
-			output << "U\t" << item->name << "\t0\n";
-			if(config->debug) {
-				std::cerr << "U\t" << item->name << "\t0\n";
+	}
+	size_t num_active = search_active.size();
+	while(num_active > 0) {
+		for(size_t a = 0; a < num_active; ) {
+			PendingRead & p = pending[search_active[a]];
+			ReadSearch & r = *p.search;
+			if(matchSearch_step(fmi, &r.match)) {
+				a++;
+				continue;
+			}
+			swap_search(r);
+			if(config->mode == MEM) length_fragment_matches(r.fragment, r.seq, r.match.first);
+			else greedy_fragment_matches(r.fragment, r.seq, r.match.first);
+			const bool searching = next_pending_fragment(p);
+			swap_search(r);
+			if(searching) a++;
+			else {
+				delete p.search;
+				p.search = nullptr;
+				search_active[a] = search_active[--num_active];
 			}
+		}
+	}
+}
+
+/* classifies the read and returns the taxon id or 0 if it is unclassified.
+ * In interleaved mode, locating the matches can be deferred to locate_pending(), then pending.back().locate is set */
+uint64_t ConsumerThread::classify_read(ReadItem * item) {
+	read_score = 0;
+	read_num_fragments = 0;
+	read_num_searched = 0;
+	read_num_located = 0;
+	if(config->trace_stream != nullptr && trace_read(item)) {
+		trace = &read_trace;
+		trace->start(item->name);
+	}
+
+	if(!translate_read(item)) {
+		if(trace) finish_trace(0, 0);
+		return 0;
+	}
 
+	uint64_t lca = 0;
+	extraoutput = "";
+
+	if(config->debug) std::cerr << fragments.size()  << " fragments found in the read."<< "\n";
+	read_num_fragments = fragments.size();
+	if(trace) {
+		for(auto const & it : fragments) {
+			trace->event("fragment") << ",\"seq\":\"" << it.second->seq << "\",\"" << (config->mode == MEM ? "length" : "score") << "\":" << it.first;
 		}
+	}
 
-		delete item;
+	if(config->delta_fmi != nullptr) {
+		lca = classify_with_delta();
+	}
+	else {
+		lca = classify_fragments();
+	}
 
-		clearFragments();
+	if(trace) finish_trace(lca, config->mode == MEM ? 0 : read_score);
 
+	clearFragments();
+
+	return lca;
+}
+
+/* searches the fragments of the read in the current index using the run mode and returns the taxon id */
+uint64_t ConsumerThread::classify_fragments() {
+	uint64_t lca = 0;
+	if(config->mode == MEM) {
+		lca = classify_length();
+	}
+	else if(config->mode == GREEDY) {
+		lca = classify_greedyblosum();
+		read_score = best_match_score;
+	}
+	else if(config->mode == BNB) {
+		lca = classify_bnb();
+		read_score = best_match_score;
 	}
+	else { // this should not happen
+		assert(false);
+	}
+	return lca;
+}
 
-	flush_output();
+/* Searches the fragments of the read in the main index, ignoring the deleted database sequences, and in the delta index.
+ * The matches with the higher score are used, and the matches from both indexes if the scores are equal. */
+uint64_t ConsumerThread::classify_with_delta() {
+	// the fragments are consumed by the search, so a copy is kept for searching the delta index
+	std::vector<std::pair<unsigned int,Fragment *>> delta_fragments;
+	for(auto const & it : fragments) delta_fragments.emplace_back(it.first, new Fragment(*it.second));
+
+	match_ids.clear();
+	match_dbnames.clear();
+	uint64_t lca = classify_fragments();
+	const unsigned int main_score = read_score;
+	const std::string main_extraoutput = extraoutput;
+	std::set<uint64_t> main_ids;
+	std::set<std::string> main_dbnames;
+	std::vector<std::string> main_matches;
+	main_ids.swap(match_ids);
+	main_dbnames.swap(match_dbnames);
+	main_matches.swap(config->mode == MEM ? longest_fragments : best_matches);
+
+	clearFragments();
+	for(auto const & it : delta_fragments) fragments.emplace(it.first, it.second);
+	fmi = config->delta_fmi;
+	bwt = config->delta_bwt;
+	astruct = config->delta_astruct;
+	deleted = nullptr;
+	repetitive_cache.swap(delta_repetitive_cache);
+	if(trace) trace->event("delta");
+
+	read_score = 0;
+	extraoutput = "";
+	uint64_t delta_lca = classify_fragments();
+
+	fmi = config->fmi;
+	bwt = config->bwt;
+	astruct = config->astruct;
+	if(!config->deleted.empty()) deleted = &config->deleted;
+	repetitive_cache.swap(delta_repetitive_cache);
+
+	// match_ids is empty if there was no match or all matches were to deleted sequences or above the E-value cutoff
+	if(match_ids.empty() || (!main_ids.empty() && main_score > read_score)) {
+		read_score = main_score;
+		extraoutput = main_extraoutput;
+		return main_ids.empty() ? 0 : lca;
+	}
+	if(main_ids.empty() || read_score > main_score) {
+		return delta_lca;
+	}
 
+	// same score in both indexes
+	match_ids.insert(main_ids.begin(), main_ids.end());
+	match_dbnames.insert(main_dbnames.begin(), main_dbnames.end());
+	if(config->verbose) {
+		std::vector<std::string> & matches = config->mode == MEM ? longest_fragments : best_matches;
+		matches.insert(matches.begin(), main_matches.begin(), main_matches.end());
+		std::stringstream ss;
+		ss << read_score << "\t";
+		for(auto it : match_ids) ss << it << ",";
+		ss  << "\t";
+		for(auto it : match_dbnames) ss << it << ",";
+		ss  << "\t";
+		for(auto it : matches) ss << it << ",";
+		extraoutput = ss.str();
+	}
+	return (match_ids.size()==1) ?  *(match_ids.begin()) : lca_from_ids(config,node2depth, match_ids);
+}
+
+/* adds the classification time of the read to the histogram and keeps the read if it is among the slowest reads */
+void ConsumerThread::record_latency(ReadItem * item, uint64_t lca, uint64_t ns) {
+	latency.add(ns);
+	if(slow_reads.size() >= config->num_slow_reads && ns <= slow_reads.front().ns) return;
+	std::ostringstream stats;
+	stats << " kaiju_time_us=" << ns / 1000 << " fragments=" << read_num_fragments << " searched=" << read_num_searched
+		<< " located=" << read_num_located << " score=" << read_score << " taxon=" << lca;
+	SlowRead r;
+	r.ns = ns;
+	r.record1 = item->record1;
+	r.record1.insert(r.record1.find('\n'), stats.str());
+	if(item->paired) {
+		r.record2 = item->record2;
+		r.record2.insert(r.record2.find('\n'), stats.str());
+	}
+	slow_reads.push_back(std::move(r));
+	std::push_heap(slow_reads.begin(), slow_reads.end(), std::greater<SlowRead>());
+	if(slow_reads.size() > config->num_slow_reads) {
+		std::pop_heap(slow_reads.begin(), slow_reads.end(), std::greater<SlowRead>());
+		slow_reads.pop_back();
+	}
+}
+
+/* writes the output line of the read and deletes it,
+ * or passes the read on to the next index in cascade mode if it is unclassified or has a lower score than required */
+void ConsumerThread::write_result(ReadItem * item, uint64_t lca, const std::string & extra, unsigned int score) {
+	if(nextQueue != nullptr && (lca == 0 || score < config->cascade[stage].min_score)) {
+		num_passed++;
+		nextQueue->push(item);
+		return;
+	}
+	std::ostringstream & output = (config->reorder_batch > 0) ? read_output : config->sample_streams.empty() ? this->output : sample_output[item->sample];
+
+	if(lca > 0) {
+		output << "C\t" << item->name << "\t" << lca;
+		if(config->verbose) output << "\t" << extra;
+		output << "\n";
+		if(config->debug) {
+			std::cerr << "C\t" << item->name << "\t" << lca << "\t" << extra << "\n";
+		}
+		if(!config->taxon_bins.empty()) {
+			bin_read(item, lca);
+		}
+
+	}
+	else  {
+		output << "U\t" << item->name << "\t0\n";
+		if(config->debug) {
+			std::cerr << "U\t" << item->name << "\t0\n";
+		}
+
+	}
+
+	if(config->reorder_batch > 0) write_ordered_output(item);
+	delete item;
 }
 
 void ConsumerThread::eval_match_scores(SI *si, Fragment * frag) {
@@ -796,44 +1446,286 @@ void ConsumerThread::eval_match_scores(SI *si, Fragment * frag) {
 
 }
 
+/* Advances row to the next row of a suffix interval with len rows in strided order, in which the first pass visits
+ * locate_stride_rows rows spread over the whole interval and each further pass the rows right after those of the
+ * previous pass. Far apart rows are more likely from different taxa, so the LCA of a broad match reaches the root
+ * after fewer rows. Returns false after the last row, starting at row 0 visits each row exactly once.
+ * The order is the same with and without verbose output, so that both report the same taxon id for reads that
+ * reach the max_match_ids limit. */
+static bool next_strided_row(IndexType & row, IndexType len) {
+	const IndexType locate_stride_rows = 16;
+	const IndexType step = (len > locate_stride_rows) ? len / locate_stride_rows : 1;
+	row += step;
+	if(row >= len) {
+		row = row % step + 1;
+		if(row >= step) return false;
+	}
+	return true;
+}
+
 void ConsumerThread::ids_from_SI(SI *si) {
-	IndexType k, pos;
+	if(match_lca.root) return;
+	if(config->repeat_cap > 0 && (IndexType)si->len > config->repeat_cap) {
+		ids_from_repetitive(si->start, (IndexType)si->len, match_ids, match_dbnames, match_lca);
+		return;
+	}
+	IndexType pos;
+	IndexType row = 0;
+	IndexType num_located = 0;
 	int iseq;
-	for (k=si->start; k<si->start+si->len; ++k) {
-
+	bool profile = false;
+	std::chrono::steady_clock::time_point t_start;
+	if(trace) t_start = std::chrono::steady_clock::now();
+	if(config->profile_sample > 0 && ++profile_counter >= config->profile_sample) {
+		profile = true;
+		profile_counter = 0;
+		profile_iseqs.clear();
+		t_start = std::chrono::steady_clock::now();
+	}
+	do {
 		// too many match ids affect AM and runtime, so use a limit now
-		if(match_ids.size() > config->max_match_ids) {
+		if(match_ids.size() > config->max_match_ids || match_lca.root) {
 			break;
 		}
 
-		get_suffix(config->fmi, config->bwt->s, k, &iseq, &pos);
-		uint64_t id = ULONG_MAX;
+		get_suffix(fmi, bwt->s, si->start + row, &iseq, &pos);
+		num_located++;
+		if(profile) profile_iseqs.push_back(iseq);
+		add_match_id(iseq, match_ids, match_dbnames, match_lca);
+	} while(next_strided_row(row, (IndexType)si->len));
+	read_num_located += (uint64_t)num_located;
+	if(profile) add_profile(si, t_start);
+	if(trace) {
+		uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_start).count();
+		trace->event("locate") << ",\"interval\":" << si->len << ",\"rows\":" << num_located << ",\"locate_ns\":" << ns;
+	}
+}
 
-		// we can have either  AX1235.1_4567, WP_12345.1_987 (Acc.Ver_taxonid) or 987 (only taxonid) as database names
-		// look for the last occurence of _
-		char * pch = strrchr(config->bwt->s->ids[iseq],'_');
-		if(pch != NULL)  { //found _, then use number after _
-			id = strtoul(pch+1,NULL,10);
-			if(id == ULONG_MAX) {
-				std::cerr << "Found bad number (out of range error) in database sequence name: " << config->bwt->s->ids[iseq] << std::endl;
-				continue;
+/* adds the taxon id of database sequence iseq to ids and its name to dbnames, and a new id to the running LCA */
+void ConsumerThread::add_match_id(int iseq, std::set<uint64_t> & ids, std::set<std::string> & dbnames, PartialLCA & lca) {
+	if(deleted != nullptr && (*deleted)[(size_t)iseq]) {
+		count_deleted++;
+		return;
+	}
+	uint64_t id = ULONG_MAX;
+
+	// we can have either  AX1235.1_4567, WP_12345.1_987 (Acc.Ver_taxonid) or 987 (only taxonid) as database names
+	// look for the last occurence of _
+	char * pch = strrchr(bwt->s->ids[iseq],'_');
+	if(pch != NULL)  { //found _, then use number after _
+		id = strtoul(pch+1,NULL,10);
+		if(id == ULONG_MAX) {
+			std::cerr << "Found bad number (out of range error) in database sequence name: " << bwt->s->ids[iseq] << std::endl;
+			return;
+		}
+		// extract db name
+		if(config->verbose && dbnames.size() < config->max_match_acc) {
+			dbnames.emplace(bwt->s->ids[iseq],pch-bwt->s->ids[iseq]);
+		}
+	}
+	else { // no _ found, use the whole database name as taxonid
+		id = strtoul(bwt->s->ids[iseq],NULL,10);
+		if(id == ULONG_MAX) {
+			std::cerr << "Found bad number (out of range error) in database sequence name: " << bwt->s->ids[iseq] << std::endl;
+			return;
+		}
+	}
+	if(ids.insert(id).second && lca_early_exit) fold_lca(lca, id);
+}
+
+/* returns the depth of a taxon id, where the root has depth 1, using the same cache as lca_from_ids() */
+unsigned int ConsumerThread::node_depth(uint64_t id) {
+	auto pos = node2depth.find(id);
+	if(pos != node2depth.end()) return pos->second;
+	unsigned int depth = 1;
+	uint64_t node = id;
+	while(config->nodes->count(node)>0 && node != config->nodes->at(node)) {
+		depth++;
+		node = config->nodes->at(node);
+	}
+	node2depth.emplace(id,depth);
+	return depth;
+}
+
+/* replaces the running LCA by the LCA of it and taxon id, ids that are not in the taxonomic tree are skipped like in lca_from_ids() */
+void ConsumerThread::fold_lca(PartialLCA & lca, uint64_t id) {
+	auto node = config->nodes->find(id);
+	if(node == config->nodes->end()) return;
+	if(lca.id == 0) {
+		lca.id = id;
+		lca.root = node->second == id;
+		return;
+	}
+	uint64_t a = lca.id;
+	uint64_t b = id;
+	unsigned int depth_a = node_depth(a);
+	unsigned int depth_b = node_depth(b);
+	for(; depth_a > depth_b; depth_a--) a = config->nodes->at(a);
+	for(; depth_b > depth_a; depth_b--) b = config->nodes->at(b);
+	while(a != b) {
+		if(depth_a <= 1) { // ids in separate trees have no common ancestor
+			lca.root = true;
+			return;
+		}
+		a = config->nodes->at(a);
+		b = config->nodes->at(b);
+		depth_a--;
+	}
+	lca.id = a;
+	lca.root = config->nodes->at(a) == a;
+}
+
+/* Adds the ids for a repetitive suffix interval with more than config->repeat_cap rows. Instead of locating all rows,
+ * only repeat_cap rows that are evenly spread over the interval are located and the resulting database sequences are
+ * cached, because the same repetitive peptides occur in many reads. The cache is cleared when it would exceed
+ * repetitive_cache_size entries or repetitive_cache_rows rows in total (64 MB per thread). */
+void ConsumerThread::ids_from_repetitive(IndexType start, IndexType len, std::set<uint64_t> & ids, std::set<std::string> & dbnames, PartialLCA & lca) {
+	const size_t repetitive_cache_size = 100000;
+	const size_t repetitive_cache_rows = (size_t)1 << 24;
+	count_repetitive++;
+	auto it = repetitive_cache.find(std::make_pair(start, len));
+	const bool cached = it != repetitive_cache.end();
+	if(cached) {
+		count_repetitive_cached++;
+	}
+	else {
+		if(repetitive_cache.size() >= repetitive_cache_size || (repetitive_cache.size() + 1) * (size_t)config->repeat_cap > repetitive_cache_rows)
+			repetitive_cache.clear();
+		std::vector<int> & iseqs = repetitive_cache[std::make_pair(start, len)];
+		iseqs.resize((size_t)config->repeat_cap);
+		for(IndexType n = 0; n < config->repeat_cap; n++) {
+			IndexType pos;
+			get_suffix(fmi, bwt->s, start + n * len / config->repeat_cap, &iseqs[(size_t)n], &pos);
+		}
+		it = repetitive_cache.find(std::make_pair(start, len));
+	}
+	if(trace) trace->event("repetitive") << ",\"interval\":" << len << ",\"cached\":" << (cached ? "true" : "false");
+	for(int iseq : it->second) {
+		// too many match ids affect AM and runtime, so use a limit now
+		if(ids.size() > config->max_match_ids || lca.root) break;
+		add_match_id(iseq, ids, dbnames, lca);
+	}
+}
+
+/* Locates the rows of the best matches of all pending reads and writes their output in input order.
+ * The lookups of the suffix array positions of all reads are interleaved, such that the memory latency
+ * of each step overlaps with the other lookups. Reads take part in rounds with up to locate_round_rows
+ * rows each, until all rows are located, a read has more than max_match_ids ids, or the LCA of its ids is the root,
+ * as in ids_from_SI(). */
+void ConsumerThread::locate_pending() {
+	locate_pending_matches();
+	write_pending();
+}
+
+/* locates the matches of the pending reads, see locate_pending(), and determines their LCA */
+void ConsumerThread::locate_pending_matches() {
+	const IndexType locate_round_rows = 16;
+	while(1) {
+		lookups.clear();
+		lookup_reads.clear();
+		for(size_t r = 0; r < pending.size(); r++) {
+			PendingRead & p = pending[r];
+			if(p.match_lca.root) p.located = true; // matches of repetitive intervals can already reach the root
+			if(!p.locate || p.located) continue;
+			for(IndexType n = 0; n < locate_round_rows && p.next_interval < p.intervals.size(); n++) {
+				lookups.emplace_back();
+				get_suffix_start(fmi, bwt->s, p.intervals[p.next_interval].first + p.next_row, &lookups.back());
+				lookup_reads.push_back(r);
+				if(!next_strided_row(p.next_row, p.intervals[p.next_interval].second)) {
+					p.next_interval++;
+					p.next_row = 0;
+				}
 			}
-			// extract db name
-			if(config->verbose && match_dbnames.size() < config->max_match_acc) {
-				match_dbnames.emplace(config->bwt->s->ids[iseq],pch-config->bwt->s->ids[iseq]);
+		}
+		if(lookups.empty()) break;
+
+		// step through all unfinished lookups in turn
+		lookup_iseqs.resize(lookups.size());
+		lookup_active.resize(lookups.size());
+		for(size_t i = 0; i < lookups.size(); i++) lookup_active[i] = i;
+		size_t num_active = lookups.size();
+		while(num_active > 0) {
+			for(size_t a = 0; a < num_active; ) {
+				const size_t i = lookup_active[a];
+				IndexType pos;
+				if(get_suffix_step(fmi, bwt->s, &lookups[i], &lookup_iseqs[i], &pos)) a++;
+				else lookup_active[a] = lookup_active[--num_active];
 			}
 		}
-		else { // no _ found, use the whole database name as taxonid
-			id = strtoul(config->bwt->s->ids[iseq],NULL,10);
-			if(id == ULONG_MAX) {
-				std::cerr << "Found bad number (out of range error) in database sequence name: " << config->bwt->s->ids[iseq] << std::endl;
+
+		for(size_t i = 0; i < lookups.size(); i++) {
+			PendingRead & p = pending[lookup_reads[i]];
+			if(p.located) continue;
+			// too many match ids affect AM and runtime, so use a limit now
+			if(p.match_ids.size() > config->max_match_ids || p.match_lca.root) {
+				p.located = true;
 				continue;
 			}
+			add_match_id(lookup_iseqs[i], p.match_ids, p.match_dbnames, p.match_lca);
+			if(p.match_lca.root) p.located = true;
+		}
+		for(auto & p : pending) {
+			if(p.locate && p.next_interval >= p.intervals.size()) p.located = true;
 		}
-		match_ids.insert(id);
+	}
+
+	for(auto & p : pending) {
+		if(p.locate && !p.match_ids.empty())
+			p.lca = (p.match_ids.size()==1) ?  *(p.match_ids.begin()) : lca_from_ids(config,node2depth, p.match_ids);
 	}
 }
 
+/* writes the output of the pending reads, whose matches are located */
+void ConsumerThread::write_pending() {
+	for(auto & p : pending) {
+		if(p.locate && config->verbose) {
+			std::stringstream ss;
+			ss << p.score << "\t" ;
+			for(auto it : p.match_ids) ss << it << ",";
+			ss  << "\t";
+			for(auto it : p.match_dbnames) ss << it << ",";
+			ss  << "\t";
+			for(auto it : p.matches) ss << it << ",";
+			p.extraoutput = ss.str();
+		}
+		write_result(p.item, p.lca, p.extraoutput, p.score);
+	}
+	pending.clear();
+}
+
+/* attributes the time for locating the rows of the interval evenly to the located database sequences */
+void ConsumerThread::add_profile(SI *si, const std::chrono::steady_clock::time_point & t_start) {
+	if(profile_iseqs.empty()) return;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count() / (double)profile_iseqs.size();
+	uint64_t interval_size = (uint64_t)si->len;
+	for(auto const & iseq : profile_iseqs) {
+		SeqProfile & p = seq_profile[iseq];
+		p.rows++;
+		p.seconds += seconds;
+	}
+	std::sort(profile_iseqs.begin(), profile_iseqs.end());
+	auto last = std::unique(profile_iseqs.begin(), profile_iseqs.end());
+	for(auto it = profile_iseqs.begin(); it != last; ++it) {
+		SeqProfile & p = seq_profile[*it];
+		p.intervals++;
+		p.interval_size_sum += interval_size;
+		if(interval_size > p.interval_size_max) p.interval_size_max = interval_size;
+	}
+}
+
+void ConsumerThread::merge_profile() {
+	std::lock_guard<std::mutex> lock(config->profile_mutex);
+	for(auto const & it : seq_profile) {
+		SeqProfile & p = config->seq_profile[it.first];
+		p.intervals += it.second.intervals;
+		p.rows += it.second.rows;
+		p.interval_size_sum += it.second.interval_size_sum;
+		p.interval_size_max = std::max(p.interval_size_max, it.second.interval_size_max);
+		p.seconds += it.second.seconds;
+	}
+	seq_profile.clear();
+}
+
 void ConsumerThread::ids_from_SI_recursive(SI *si) {
 	SI * si_it = si;
 	while(si_it) {
@@ -844,15 +1736,125 @@ void ConsumerThread::ids_from_SI_recursive(SI *si) {
 	}
 }
 
+void ConsumerThread::bin_read(ReadItem * item, uint64_t lca) {
+	auto it = config->node2interval.find(lca);
+	if(it == config->node2interval.end()) return;
+	uint32_t pre = it->second.first;
+	for(size_t i = 0; i < config->taxon_bins.size(); i++) {
+		const std::pair<uint32_t,uint32_t> & interval = config->taxon_bins[i].interval;
+		if(pre < interval.first || pre > interval.second) continue;
+		bin_output1[i] += item->record1;
+		if(item->paired) bin_output2[i] += item->record2;
+		bin_counts[i]++;
+	}
+}
+
+std::mutex ConsumerThread::output_mutex;
+
 void ConsumerThread::flush_output() {
-	static std::mutex m;
 
 	{
-	std::lock_guard<std::mutex> out_lock(m);
+	std::lock_guard<std::mutex> out_lock(output_mutex);
 	*(config->out_stream) << output.str();
+	if(config->trace_stream != nullptr) *(config->trace_stream) << trace_output.str();
+	for(size_t i = 0; i < sample_output.size(); i++) {
+		*(config->sample_streams[i]) << sample_output[i].str();
+	}
+	for(size_t i = 0; i < bin_output1.size(); i++) {
+		TaxonBin & bin = config->taxon_bins[i];
+		if(!bin_output1[i].empty() && gzwrite(bin.file1, bin_output1[i].data(), (unsigned int)bin_output1[i].length()) == 0) {
+			error("Could not write to output file for taxon " + std::to_string(bin.taxon_id));
+		}
+		if(!bin_output2[i].empty() && gzwrite(bin.file2, bin_output2[i].data(), (unsigned int)bin_output2[i].length()) == 0) {
+			error("Could not write to output file for taxon " + std::to_string(bin.taxon_id));
+		}
+		bin.num_reads += bin_counts[i];
+	}
 	}
 
 	output.str("");
+	trace_output.str("");
+	for(auto & o : sample_output) {
+		o.str("");
+	}
+	for(size_t i = 0; i < bin_output1.size(); i++) {
+		bin_output1[i].clear();
+		bin_output2[i].clear();
+		bin_counts[i] = 0;
+	}
+}
+
+/* stores the output of the read in its batch and writes all batches that are complete in input order */
+void ConsumerThread::write_ordered_output(ReadItem * item) {
+	std::lock_guard<std::mutex> out_lock(output_mutex);
+	auto it = config->read_batches.find(item->serial / config->reorder_batch);
+	assert(it != config->read_batches.end());
+	it->second.output[item->serial % config->reorder_batch] = read_output.str();
+	it->second.missing--;
+	while(!config->read_batches.empty()) {
+		auto first = config->read_batches.begin();
+		if(first->first != config->next_batch || first->second.missing > 0) break;
+		for(const auto & s : first->second.output) {
+			*(config->out_stream) << s;
+		}
+		config->read_batches.erase(first);
+		config->next_batch++;
+	}
+	read_output.str("");
+}
+
+/* decides whether the read is traced, either by name or by a sample of reads with pseudo-random but reproducible hash values */
+bool ConsumerThread::trace_read(const ReadItem * item) {
+	if(config->trace_sample > 0 && std::hash<std::string>()(item->name) % config->trace_sample == 0) return true;
+	return !config->trace_reads.empty() && config->trace_reads.count(item->name) > 0;
+}
+
+void ConsumerThread::finish_trace(uint64_t lca, unsigned int score) {
+	trace->event("result") << ",\"taxon\":" << lca << ",\"score\":" << score;
+	trace->finish();
+	trace_output << trace->json.str();
+	trace = nullptr;
+}
+
+/* records length and number of rows of all suffix array intervals found for the current fragment */
+void ConsumerThread::trace_SI(SI * si) {
+	uint64_t intervals = 0, rows = 0;
+	for(SI * s = si; s; s = s->next) {
+		for(SI * t = s; t; t = t->samelen) {
+			intervals++;
+			rows += (uint64_t)t->len;
+		}
+	}
+	trace->event("match") << ",\"ql\":" << si->ql << ",\"intervals\":" << intervals << ",\"rows\":" << rows;
+}
+
+void ReadTrace::start(const std::string & name) {
+	t_start = std::chrono::steady_clock::now();
+	has_events = false;
+	json.str("");
+	json << "{\"read\":\"";
+	for(char c : name) {
+		if(c == '"' || c == '\\') json << '\\' << c;
+		else if((unsigned char)c < 0x20) json << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf] << "0123456789abcdef"[c & 0xf];
+		else json << c;
+	}
+	json << "\",\"events\":[";
+}
+
+std::ostream & ReadTrace::event(const char * type) {
+	if(has_events) json << "},";
+	has_events = true;
+	json << "{\"ev\":\"" << type << "\",\"ns\":" << elapsed_ns();
+	return json;
+}
+
+void ReadTrace::finish() {
+	if(has_events) json << "}";
+	json << "],\"ns\":" << elapsed_ns() << "}\n";
+}
+
+inline uint64_t ReadTrace::elapsed_ns() const {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_start).count();
 }
 
 void ConsumerThread::clearFragments() {
@@ -24,6 +24,7 @@
 #include <utility>
 #include <functional>
 #include <locale>
+#include <chrono>
 
 #include "ReadItem.hpp"
 #include "Config.hpp"
@@ -61,6 +62,71 @@ class Fragment {
 	Fragment(const std::string & s, unsigned int n, unsigned int p) : seq(s), num_mm(n), pos_lastmm(p) { }
 };
 
+/* structured events of one traced read, which is written as one line of JSON to config->trace_stream */
+class ReadTrace {
+	public:
+	std::ostringstream json;
+	void start(const std::string & name);
+	std::ostream & event(const char * type); // fields of the event are appended as ,"key":value
+	void finish();
+	private:
+	std::chrono::steady_clock::time_point t_start;
+	bool has_events = false;
+	uint64_t elapsed_ns() const;
+};
+
+/* lowest common ancestor of the taxon ids of the matches of a read that are located so far, see ConsumerThread::fold_lca() */
+class PartialLCA {
+	public:
+	uint64_t id = 0; // 0 = no ids yet
+	bool root = false; // the LCA is the root of the taxonomy, so further matches cannot change it
+};
+
+/* state of the search of the fragments of a read, which is interleaved with the searches of other reads,
+ * see ConsumerThread::search_pending(). The members are swapped with those used by the search functions of ConsumerThread. */
+class ReadSearch {
+	public:
+	std::multimap<unsigned int,Fragment *,std::greater<unsigned int>> fragments;
+	std::vector<SI *> matches_SI; // best or longest matches
+	std::vector<std::string> matches;
+	unsigned int score = 0; // best match score, or match length in MEM mode
+	double query_len = 0.0;
+	Fragment * fragment = nullptr; // fragment that is currently searched
+	char * seq = nullptr; // letter codes of fragment
+	MatchSearch match;
+};
+
+/* read that waits for locating its best matches together with other reads, see ConsumerThread::locate_pending() */
+class PendingRead {
+	public:
+	ReadItem * item;
+	uint64_t lca = 0;
+	std::string extraoutput;
+	bool locate = false; // true if the rows of intervals still need to be located for determining lca
+	bool located = false;
+	unsigned int score = 0; // best match score, or match length in MEM mode
+	std::vector<std::pair<IndexType,IndexType>> intervals; // start and length of the suffix array intervals of the best matches
+	std::vector<std::string> matches; // matching sequences, only used for verbose output
+	std::set<uint64_t> match_ids;
+	std::set<std::string> match_dbnames;
+	PartialLCA match_lca;
+	size_t next_interval = 0; // the next row to be located is row next_row in intervals[next_interval], see next_strided_row()
+	IndexType next_row = 0;
+	std::vector<std::pair<unsigned int,Fragment *>> fragments; // fragments in search order, passed from the translate to the search stage
+	double query_len = 0.0;
+	ReadSearch * search = nullptr; // set while the fragments of the read are searched by ConsumerThread::search_pending()
+	PendingRead(ReadItem * r) : item(r) { }
+};
+
+/* stages of the classification pipeline, each run by its own threads, see ConsumerThread::doPipelineWork() */
+enum PipelineStage { TRANSLATE, SEARCH, LOCATE, OUTPUT };
+
+/* reads that are passed together from one stage of the pipeline to the next */
+class PipelineBatch {
+	public:
+	std::vector<PendingRead> reads;
+};
+
 class ConsumerThread {
 	protected:
 	ProducerConsumerQueue<ReadItem*> * myWorkQueue;
@@ -85,8 +151,12 @@ class ConsumerThread {
 	std::vector<SI *> longest_matches_SI;
 	std::vector<std::string> best_matches;
 	std::vector<std::string> longest_fragments;
+	unsigned int longest_match_length = 0;
 	std::set<uint64_t> match_ids;
 	std::set<std::string> match_dbnames;
+	PartialLCA match_lca;
+	bool lca_early_exit = false; // stop locating once the LCA of a read is the root, not in verbose mode
+	bool defer_locate = false; // locating is deferred to locate_pending() in interleaved mode and in the pipeline
 
 	unsigned int best_match_score = 0;
 	std::string extraoutput = "";
@@ -95,10 +165,58 @@ class ConsumerThread {
 
 	Config * config;
 	std::ostringstream output;
+	std::vector<std::ostringstream> sample_output; // per-thread buffers for config->sample_streams
+	std::ostringstream read_output; // output of the current read when reordering reads
+	std::vector<std::string> bin_output1; // per-thread buffers for config->taxon_bins
+	std::vector<std::string> bin_output2;
+	std::vector<uint64_t> bin_counts;
 	uint32_t read_count = 0;
+
+	unsigned int profile_counter = 0;
+	std::vector<int> profile_iseqs;
+	std::unordered_map<int,SeqProfile> seq_profile;
+	void add_profile(SI *, const std::chrono::steady_clock::time_point &);
+	void merge_profile();
+
+	// classification time and search statistics of each read, see config->num_slow_reads
+	LatencyHistogram latency;
+	std::vector<SlowRead> slow_reads; // min-heap of the slowest reads
+	size_t read_num_fragments = 0;
+	size_t read_num_searched = 0;
+	uint64_t read_num_located = 0;
+	void record_latency(ReadItem *, uint64_t, uint64_t);
+
+	ReadTrace read_trace;
+	ReadTrace * trace = nullptr; // points to read_trace while the current read is traced, otherwise nullptr
+	std::ostringstream trace_output;
+	bool trace_read(const ReadItem *);
+	void finish_trace(uint64_t, unsigned int);
+	void trace_SI(SI *);
+	char * fragment_codes(const Fragment *);
 	uint64_t classify_length();
+	void length_fragment_matches(Fragment *, char *, SI *);
+	uint64_t lca_from_longest_matches();
 	uint64_t classify_greedyblosum();
+	void greedy_fragment_matches(Fragment *, char *, SI *);
+	uint64_t classify_bnb();
+	uint64_t lca_from_best_matches();
+
+	// used in branch-and-bound mode
+	int bnb_alen = 0;
+	std::vector<int> bnb_scores; // BLOSUM62 for letter codes, bnb_scores[a * bnb_alen + b]
+	std::vector<std::vector<uchar>> bnb_order; // for each letter, all letters sorted by decreasing score
+	std::string bnb_query;
+	std::vector<int> bnb_prefix;
+	std::vector<uchar> bnb_path;
+	std::vector<IndexType> bnb_occ; // FMindexAll of both interval ends for each query position
+	int bnb_lower = 0; // score of the best exact match in the current fragment
+	int bnb_min_score = 0; // min_score, raised to the score needed for passing the E-value cutoff
+	void bnb_extend(int, int, IndexType *, int, int, unsigned int);
+	void bnb_record(IndexType *, int, int, int);
+	int bnb_threshold();
 
+	bool translate_read(ReadItem *);
+	bool split_SEG(Fragment *);
 	void clearFragments();
 	unsigned int calcScore(const std::string &);
 	unsigned int calcScore(const std::string &, int);
@@ -110,12 +228,62 @@ class ConsumerThread {
 	void eval_match_scores(SI *si, Fragment *);
 	void ids_from_SI_recursive(SI *si);
 	void ids_from_SI(SI *si);
+	void add_match_id(int, std::set<uint64_t> &, std::set<std::string> &, PartialLCA &);
+	unsigned int node_depth(uint64_t);
+	void fold_lca(PartialLCA &, uint64_t);
+
+	// sampled database sequences of repetitive suffix intervals, see config->repeat_cap
+	std::map<std::pair<IndexType,IndexType>,std::vector<int>> repetitive_cache;
+	uint64_t count_repetitive = 0;
+	uint64_t count_repetitive_cached = 0;
+	void ids_from_repetitive(IndexType, IndexType, std::set<uint64_t> &, std::set<std::string> &, PartialLCA &);
+	uint64_t classify_read(ReadItem *);
+	uint64_t classify_fragments();
+	uint64_t classify_with_delta();
+	void write_result(ReadItem *, uint64_t, const std::string &, unsigned int);
+	unsigned int read_score = 0; // best match score of the current read, or match length in MEM mode
+
+	// the index used by this thread, which is one stage of config->cascade in cascade mode
+	size_t stage = 0;
+	ProducerConsumerQueue<ReadItem*> * nextQueue = nullptr; // reads are passed on to the threads of the next stage
+	uint64_t num_passed = 0;
+	FMI * fmi;
+	BWT * bwt;
+	AlphabetStruct * astruct;
+	double db_length;
+
+	// used with a delta index, see config->delta_fmi
+	const std::vector<bool> * deleted = nullptr; // config->deleted while searching the main index, otherwise nullptr
+	uint64_t count_deleted = 0;
+	std::map<std::pair<IndexType,IndexType>,std::vector<int>> delta_repetitive_cache; // swapped with repetitive_cache while searching the delta index
+
+	// used in interleaved mode, see config->interleave
+	std::vector<PendingRead> pending;
+	std::vector<SuffixLookup> lookups;
+	std::vector<size_t> lookup_reads; // index into pending for each lookup
+	std::vector<int> lookup_iseqs;
+	std::vector<size_t> lookup_active;
+	std::vector<size_t> search_active; // indexes into pending of the reads whose search is not finished
+	PendingRead * deferred_read = nullptr; // pending read whose locating is deferred by lca_from_best_matches()
+	bool start_pending_search(PendingRead &);
+	void swap_search(ReadSearch &);
+	bool next_pending_fragment(PendingRead &);
+	void search_pending();
+	void locate_pending();
+	void locate_pending_matches();
+	void write_pending();
+	void translate_batch(PipelineBatch *);
+	void search_batch(PipelineBatch *);
 	void getAllFragmentsBits(const std::string & line);
+	void bin_read(ReadItem *, uint64_t);
 	void flush_output();
+	void write_ordered_output(ReadItem *);
 
 	public:
-	ConsumerThread(ProducerConsumerQueue<ReadItem*>* workQueue, Config * config);
+	ConsumerThread(ProducerConsumerQueue<ReadItem*>* workQueue, Config * config, size_t stage = 0, ProducerConsumerQueue<ReadItem*>* nextQueue = nullptr);
 	void doWork();
+	void doPipelineWork(PipelineStage, ProducerConsumerQueue<PipelineBatch*>*, ProducerConsumerQueue<PipelineBatch*>*);
+	static std::mutex output_mutex; // guards all writing to the output files of config
 
 
 };
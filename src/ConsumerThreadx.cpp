@@ -22,19 +22,19 @@ void ConsumerThreadx::classify_greedyblosum() {
 			char * seq = new char[length+1];
 			std::strcpy(seq, fragment.c_str());
 
-			translate2numbers((uchar *)seq, (unsigned int)length, config->astruct);
+			translate2numbers((uchar *)seq, (unsigned int)length, astruct);
 
 			SI * si = NULL;
 			if(num_mm > 0) {
 				if(num_mm == config->mismatches) { //after last mm has been done, we need to have at least reached the min_length
-					si = maxMatches_withStart(config->fmi, seq, (unsigned int)length, config->min_fragment_length, 1,t->si0,t->si1,t->matchlen);
+					si = maxMatches_withStart(fmi, seq, (unsigned int)length, config->min_fragment_length, 1,t->si0,t->si1,t->matchlen);
 				}
 				else {
-					si = maxMatches_withStart(config->fmi, seq, (unsigned int)length, t->matchlen, 1,t->si0,t->si1,t->matchlen);
+					si = maxMatches_withStart(fmi, seq, (unsigned int)length, t->matchlen, 1,t->si0,t->si1,t->matchlen);
 				}
 			}
 			else {
-				si = maxMatches(config->fmi, seq, (unsigned int)length, config->seed_length, 0); //initial matches
+				si = maxMatches(fmi, seq, (unsigned int)length, config->seed_length, 0); //initial matches
 			}
 
 			if(!si) {// no match for this fragment
@@ -84,7 +84,7 @@ void ConsumerThreadx::classify_greedyblosum() {
 			//calc e-value and only return match if > cutoff
 
 			double bitscore = (LAMBDA * best_match_score - LN_K) / LN_2;
-			double Evalue = config->db_length * query_len * pow(2, -1 * bitscore);
+			double Evalue = db_length * query_len * pow(2, -1 * bitscore);
 			if(config->debug) std::cerr << "E-value = " << Evalue << std::endl;
 
 			if(Evalue > config->min_Evalue) {
@@ -130,9 +130,9 @@ void ConsumerThreadx::classify_length() {
 			char * seq = new char[length+1];
 			std::strcpy(seq, fragment.c_str());
 
-			translate2numbers((uchar *)seq, length, config->astruct);
+			translate2numbers((uchar *)seq, length, astruct);
 			//use longest_match_length here too:
-			SI * si = maxMatches(config->fmi, seq, length, std::max(config->min_fragment_length,longest_match_length),  1);
+			SI * si = maxMatches(fmi, seq, length, std::max(config->min_fragment_length,longest_match_length),  1);
 
 			if(!si) {// no match for this fragment
 				if(config->debug) std::cerr << "No match for this fragment." << "\n";
@@ -265,8 +265,8 @@ void ConsumerThreadx::ids_from_SI(SI *si) {
 		if(match_ids.size() > config->max_match_ids) {
 			break;
 		}
-		get_suffix(config->fmi, config->bwt->s, k, &iseq, &pos);
-		match_ids.insert(config->bwt->s->ids[iseq]);
+		get_suffix(fmi, bwt->s, k, &iseq, &pos);
+		match_ids.insert(bwt->s->ids[iseq]);
 	}
 }
 
@@ -279,8 +279,8 @@ void ConsumerThreadx::ids_from_SI_recursive(SI *si) {
 			if(match_ids.size() > config->max_match_ids) {
 				break;
 			}
-			get_suffix(config->fmi, config->bwt->s, k, &iseq, &pos);
-			match_ids.insert(config->bwt->s->ids[iseq]);
+			get_suffix(fmi, bwt->s, k, &iseq, &pos);
+			match_ids.insert(bwt->s->ids[iseq]);
 		} // end for
 		si_it = si_it->samelen;
 	} // end while all SI with same length
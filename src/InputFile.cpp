@@ -0,0 +1,92 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+
+#include <stdlib.h>
+#include <fstream>
+
+#include "InputFile.hpp"
+#include "util.hpp"
+
+const size_t block_size = 1 << 20;
+
+bool InputFileBuf::open(const std::string & fname) {
+	filename = fname;
+	std::ifstream test_file(filename, std::ios::binary);
+	if(!test_file.is_open()) return false;
+	unsigned char magic[4] = {0, 0, 0, 0};
+	test_file.read(reinterpret_cast<char *>(magic), 4);
+	test_file.close();
+
+	if(magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) {
+		std::string quoted = "'";
+		for(char c : filename) {
+			if(c == '\'') quoted += "'\\''";
+			else quoted += c;
+		}
+		quoted += "'";
+		zstd_pipe = popen(("zstd -dc -- " + quoted).c_str(), "r");
+		if(zstd_pipe == NULL) return false;
+	}
+	else {
+		try {
+			gz_file = new zstr::ifstream(filename);
+			if(!gz_file->good()) return false;
+		} catch(std::exception & e) { return false; }
+	}
+	reader = std::thread(&InputFileBuf::read_blocks, this);
+	return true;
+}
+
+void InputFileBuf::close() {
+	if(reader.joinable()) {
+		// unblock the reader thread if the file was not read until the end
+		stop = true;
+		std::string * b;
+		while(blocks.pop(&b)) delete b;
+		reader.join();
+	}
+	delete current;
+	current = nullptr;
+	delete gz_file;
+	gz_file = nullptr;
+	setg(nullptr, nullptr, nullptr);
+}
+
+size_t InputFileBuf::read_source(char * dest, size_t n) {
+	if(zstd_pipe) {
+		return fread(dest, 1, n, zstd_pipe);
+	}
+	gz_file->read(dest, (std::streamsize)n);
+	return (size_t)gz_file->gcount();
+}
+
+/* runs in the reader thread */
+void InputFileBuf::read_blocks() {
+	try {
+		while(!stop) {
+			std::string * b = new std::string(block_size, '\0');
+			size_t n = read_source(&(*b)[0], block_size);
+			if(n == 0) { delete b; break; }
+			b->resize(n);
+			blocks.push(b);
+		}
+	} catch(std::exception & e) { read_error = true; }
+	if(zstd_pipe && pclose(zstd_pipe) != 0 && !stop) read_error = true;
+	zstd_pipe = nullptr;
+	blocks.pushedLast();
+}
+
+int InputFileBuf::underflow() {
+	if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+	delete current;
+	current = nullptr;
+	if(finished || !blocks.pop(&current)) {
+		finished = true;
+		if(read_error) { error("Could not read file " + filename + " until the end. For zstd-compressed files, the program zstd needs to be installed."); exit(EXIT_FAILURE); }
+		setg(nullptr, nullptr, nullptr);
+		return traits_type::eof();
+	}
+	char * data = &(*current)[0];
+	setg(data, data, data + current->length());
+	return traits_type::to_int_type(*gptr());
+}
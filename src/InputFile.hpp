@@ -0,0 +1,62 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <stdio.h>
+#include <atomic>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include "ProducerConsumerQueue/src/ProducerConsumerQueue.hpp"
+#include "zstr/zstr.hpp"
+
+/* Stream buffer that is filled with blocks of data read by a separate thread,
+ * such that decompression runs in parallel to parsing the lines of the file. */
+class InputFileBuf : public std::streambuf {
+	public:
+		InputFileBuf() : blocks(4) { }
+		~InputFileBuf() { close(); }
+		bool open(const std::string & filename);
+		void close();
+
+	protected:
+		int underflow();
+
+	private:
+		void read_blocks();
+		size_t read_source(char *, size_t);
+
+		std::string filename;
+		zstr::ifstream * gz_file = nullptr; // plain or gzip-compressed file
+		FILE * zstd_pipe = nullptr; // zstd-compressed file, decompressed by a zstd process
+		std::thread reader;
+		ProducerConsumerQueue<std::string *> blocks;
+		std::string * current = nullptr;
+		bool finished = false;
+		std::atomic<bool> read_error{false};
+		std::atomic<bool> stop{false}; // set when the stream is closed before the end of the file
+};
+
+/* Input stream for text files, which can be uncompressed, gzip-compressed (also with multiple members),
+ * or zstd-compressed. zstd-compressed files are detected by their magic number and need the zstd program.
+ * Exits with an error message if the file cannot be read or decompressed until the end. */
+class InputFile : public std::istream {
+	public:
+		InputFile(const std::string & filename) : std::istream(nullptr) {
+			rdbuf(&buf);
+			opened = buf.open(filename);
+			if(!opened) setstate(std::ios::failbit);
+		}
+		bool is_open() const { return opened; }
+		void close() { buf.close(); opened = false; }
+
+	private:
+		InputFileBuf buf;
+		bool opened = false;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #ifndef READ_ITEM_H
 #define READ_ITEM_H
 
+#include <stdint.h>
 #include <string>
 
 class ReadItem {
@@ -11,7 +12,11 @@ class ReadItem {
         std::string name;
         std::string sequence1;
         std::string sequence2;
+        std::string record1; // raw FASTQ/FASTA records, only kept when binning reads by taxon
+        std::string record2;
         bool paired = false;
+        int sample = 0; // index into Config::sample_streams when demultiplexing reads by barcode
+        uint64_t serial = 0; // position in the input file, used for restoring the order of reordered reads
         ReadItem(const std::string &, const std::string &);
         ReadItem(const std::string &, const std::string &, const std::string &);
 };
@@ -0,0 +1,190 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <algorithm>
+
+#include "ResultStore.hpp"
+#include "util.hpp"
+
+std::string result_line_name(const std::string & line) {
+	size_t start = line.find('\t');
+	if(start == std::string::npos) return "";
+	size_t end = line.find('\t', start + 1);
+	if(end == std::string::npos) end = line.length();
+	return line.substr(start + 1, end - start - 1);
+}
+
+bool ResultStoreWriter::open(const std::string & filename) {
+	file = fopen(filename.c_str(), "wb");
+	if(file == NULL) return false;
+	fwrite(result_store_magic, 1, sizeof(result_store_magic), file);
+	pos = sizeof(result_store_magic);
+	return true;
+}
+
+void ResultStoreWriter::add(const std::string & name, const std::string & line) {
+	if(num_lines > 0 && name < last_name) {
+		error("Lines must be added to the result store in sorted order of read names, but " + name + " comes after " + last_name);
+		exit(EXIT_FAILURE);
+	}
+	// lines with the same read name may span several blocks, which is handled by the lookup
+	if(block.length() >= block_size) write_block();
+	if(block.empty()) block_first_name = name;
+	block += line;
+	block += '\n';
+	last_name = name;
+	num_lines++;
+}
+
+void ResultStoreWriter::write_block() {
+	if(block.empty()) return;
+	uLongf compressed_size = compressBound(block.length());
+	compressed.resize(compressed_size);
+	if(compress2(compressed.data(), &compressed_size, (const Bytef *)block.data(), block.length(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+		error("Could not compress block of result store.");
+		exit(EXIT_FAILURE);
+	}
+	if(fwrite(compressed.data(), 1, compressed_size, file) != compressed_size) {
+		error("Could not write to result store.");
+		exit(EXIT_FAILURE);
+	}
+	index.push_back({pos, (uint32_t)compressed_size, (uint32_t)block.length(), names.length(), block_first_name.length()});
+	names += block_first_name;
+	pos += compressed_size;
+	block.clear();
+}
+
+void ResultStoreWriter::close() {
+	if(file == NULL) return;
+	write_block();
+	ResultStoreTrailer trailer;
+	trailer.num_blocks = index.size();
+	trailer.num_lines = num_lines;
+	trailer.index_offset = pos;
+	trailer.names_offset = pos + index.size() * sizeof(ResultStoreBlock);
+	memcpy(trailer.magic, result_store_magic, sizeof(result_store_magic));
+	fwrite(index.data(), sizeof(ResultStoreBlock), index.size(), file);
+	fwrite(names.data(), 1, names.length(), file);
+	fwrite(&trailer, sizeof(trailer), 1, file);
+	if(ferror(file) || fclose(file) != 0) {
+		error("Could not write to result store.");
+		exit(EXIT_FAILURE);
+	}
+	file = NULL;
+}
+
+bool ResultStore::open(const std::string & filename) {
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(result_store_magic) + sizeof(ResultStoreTrailer)) { ::close(fd); return false; }
+	map_size = (size_t)st.st_size;
+	void * m = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(m == MAP_FAILED) return false;
+	map = (const char *)m;
+	// the file is checked before use, such that a truncated or corrupted file cannot cause reads outside of the mapping
+	const size_t trailer_offset = map_size - sizeof(ResultStoreTrailer);
+	memcpy(&trailer, map + trailer_offset, sizeof(ResultStoreTrailer));
+	if(memcmp(map, result_store_magic, sizeof(result_store_magic)) != 0 || memcmp(trailer.magic, result_store_magic, sizeof(result_store_magic)) != 0 ||
+		trailer.index_offset < sizeof(result_store_magic) || trailer.index_offset > trailer.names_offset || trailer.names_offset > trailer_offset ||
+		(trailer.names_offset - trailer.index_offset) % sizeof(ResultStoreBlock) != 0 ||
+		(trailer.names_offset - trailer.index_offset) / sizeof(ResultStoreBlock) != trailer.num_blocks) {
+		close();
+		return false;
+	}
+	index = map + trailer.index_offset;
+	names = map + trailer.names_offset;
+	const uint64_t names_size = trailer_offset - trailer.names_offset;
+	for(uint64_t i = 0; i < trailer.num_blocks; i++) {
+		ResultStoreBlock b = index_entry(i);
+		if(b.offset < sizeof(result_store_magic) || b.offset > trailer.index_offset || b.compressed_size > trailer.index_offset - b.offset ||
+			b.name_offset > names_size || b.name_length > names_size - b.name_offset) {
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void ResultStore::close() {
+	if(map) munmap((void *)map, map_size);
+	map = nullptr;
+	index = nullptr;
+	names = nullptr;
+	cached_block = UINT64_MAX;
+}
+
+ResultStoreBlock ResultStore::index_entry(uint64_t i) const {
+	ResultStoreBlock b;
+	memcpy(&b, index + i * sizeof(ResultStoreBlock), sizeof(ResultStoreBlock));
+	return b;
+}
+
+int ResultStore::compare_block_name(uint64_t i, const std::string & name) const {
+	const ResultStoreBlock b = index_entry(i);
+	int c = memcmp(names + b.name_offset, name.data(), std::min((size_t)b.name_length, name.length()));
+	if(c != 0) return c;
+	if(b.name_length < name.length()) return -1;
+	return b.name_length > name.length() ? 1 : 0;
+}
+
+const std::string & ResultStore::get_block(uint64_t i) {
+	if(i == cached_block) return block;
+	const ResultStoreBlock b = index_entry(i);
+	block.resize(b.size);
+	uLongf size = b.size;
+	if(uncompress((Bytef *)&block[0], &size, (const Bytef *)(map + b.offset), b.compressed_size) != Z_OK || size != b.size) {
+		error("Could not decompress block " + std::to_string(i) + " of result store.");
+		exit(EXIT_FAILURE);
+	}
+	cached_block = i;
+	return block;
+}
+
+void ResultStore::scan(const std::string & first, const std::string & last, std::vector<std::string> & lines) {
+	if(map == nullptr || trailer.num_blocks == 0) return;
+	// find first block whose first name is not smaller than first, lines with that name may also be in the preceding block
+	uint64_t lo = 0, hi = trailer.num_blocks;
+	if(!first.empty()) {
+		while(lo < hi) {
+			uint64_t mid = lo + (hi - lo) / 2;
+			if(compare_block_name(mid, first) < 0) lo = mid + 1;
+			else hi = mid;
+		}
+		if(lo > 0) lo--;
+	}
+	for(uint64_t i = lo; i < trailer.num_blocks; i++) {
+		if(!last.empty() && compare_block_name(i, last) > 0) return;
+		const std::string & b = get_block(i);
+		size_t start = 0;
+		while(start < b.length()) {
+			size_t end = b.find('\n', start);
+			if(end == std::string::npos) end = b.length();
+			size_t name_start = b.find('\t', start);
+			if(name_start != std::string::npos && name_start < end) {
+				name_start++;
+				size_t name_end = b.find('\t', name_start);
+				if(name_end == std::string::npos || name_end > end) name_end = end;
+				size_t name_length = name_end - name_start;
+				if(!first.empty() && b.compare(name_start, name_length, first) < 0) { start = end + 1; continue; }
+				if(!last.empty() && b.compare(name_start, name_length, last) > 0) return;
+				lines.emplace_back(b, start, end - start);
+			}
+			start = end + 1;
+		}
+	}
+}
+
+size_t ResultStore::lookup(const std::string & name, std::vector<std::string> & lines) {
+	size_t n = lines.size();
+	scan(name, name, lines);
+	return lines.size() - n;
+}
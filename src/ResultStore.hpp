@@ -0,0 +1,92 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* The result store is a file containing the lines of a Kaiju output file sorted by read name.
+ * The lines are stored in zlib-compressed blocks, followed by an index with the offset and the first
+ * read name of each block, which is binary searched in the memory-mapped file for each lookup.
+ *
+ * Layout: magic | compressed blocks | block index entries | first read names of blocks | trailer */
+
+const char result_store_magic[8] = {'K','A','I','J','U','R','S','1'};
+
+struct ResultStoreBlock {
+	uint64_t offset; // position of compressed block in file
+	uint32_t compressed_size;
+	uint32_t size;
+	uint64_t name_offset; // position of first read name in the names area
+	uint64_t name_length;
+};
+
+struct ResultStoreTrailer {
+	uint64_t num_blocks;
+	uint64_t num_lines;
+	uint64_t index_offset;
+	uint64_t names_offset;
+	char magic[8];
+};
+
+/* Returns the read name in the second column of a line from Kaiju's output,
+ * or an empty string if the line has less than two columns. */
+std::string result_line_name(const std::string & line);
+
+/* Writes lines, which must be added in the order of their read names, into a result store file. */
+class ResultStoreWriter {
+	public:
+		ResultStoreWriter(size_t block_size = 1 << 16) : block_size(block_size) { }
+		~ResultStoreWriter() { close(); }
+		bool open(const std::string & filename);
+		void add(const std::string & name, const std::string & line);
+		void close();
+		uint64_t num_lines = 0;
+
+	private:
+		void write_block();
+
+		size_t block_size;
+		FILE * file = nullptr;
+		uint64_t pos = 0;
+		std::string block;
+		std::string block_first_name;
+		std::string last_name;
+		std::string names;
+		std::vector<ResultStoreBlock> index;
+		std::vector<unsigned char> compressed;
+};
+
+/* Read-only access to a memory-mapped result store file. */
+class ResultStore {
+	public:
+		~ResultStore() { close(); }
+		bool open(const std::string & filename);
+		void close();
+		/* Appends all lines with read names between first and last (inclusive) to lines.
+		 * An empty string for first or last means no limit on that side. */
+		void scan(const std::string & first, const std::string & last, std::vector<std::string> & lines);
+		/* Appends the lines for the given read name to lines and returns their number. */
+		size_t lookup(const std::string & name, std::vector<std::string> & lines);
+		uint64_t num_lines() const { return map ? trailer.num_lines : 0; }
+		uint64_t num_blocks() const { return map ? trailer.num_blocks : 0; }
+
+	private:
+		ResultStoreBlock index_entry(uint64_t i) const;
+		int compare_block_name(uint64_t i, const std::string & name) const;
+		const std::string & get_block(uint64_t i);
+
+		const char * map = nullptr;
+		size_t map_size = 0;
+		ResultStoreTrailer trailer; // copied from the end of the file, which is not aligned
+		const char * index = nullptr; // block index entries, which are copied by index_entry() because they may be unaligned
+		const char * names = nullptr;
+		uint64_t cached_block = UINT64_MAX; // the last decompressed block is kept for consecutive lookups
+		std::string block;
+};
+
+#endif
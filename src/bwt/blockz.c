@@ -0,0 +1,165 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "common.h"
+#include "blockz.h"
+
+
+
+/* Shared state of the threads working on one section */
+typedef struct {
+  FILE *fp;
+  uchar *data;        // uncompressed section
+  size_t size;
+  uint64_t nblocks;
+  uint64_t first;     // first block of the current batch when writing
+  uint64_t last;      // end of the current batch when writing
+  uint64_t next;      // next block to be taken by a thread
+  uint64_t *csize;    // compressed size of each block
+  uint64_t *offset;   // file offset of each compressed block when reading
+  uchar **cblocks;    // compressed blocks of the current batch when writing
+  int level;
+  int failed;
+} ZSection;
+
+
+static inline size_t block_length(ZSection *z, uint64_t i) {
+  size_t start = (size_t)i*ZSECTION_BLOCKSIZE;
+  return (z->size-start < ZSECTION_BLOCKSIZE) ? z->size-start : ZSECTION_BLOCKSIZE;
+}
+
+
+
+static void *compress_blocks(void *arg) {
+  ZSection *z = (ZSection *)arg;
+  uint64_t i;
+  uLongf clen;
+
+  while ( (i = __sync_fetch_and_add(&(z->next),1)) < z->last ) {
+    clen = compressBound(block_length(z,i));
+    z->cblocks[i-z->first] = (uchar *)malloc(clen);
+    if (compress2(z->cblocks[i-z->first], &clen, z->data+(size_t)i*ZSECTION_BLOCKSIZE, block_length(z,i), z->level) != Z_OK) z->failed=1;
+    z->csize[i] = clen;
+  }
+  return NULL;
+}
+
+
+
+/* Write size bytes of data as a block-compressed section, compressing the
+   blocks with nthreads threads in batches.
+*/
+void write_zsection(FILE *fp, const uchar *data, size_t size, int level, int nthreads) {
+  ZSection z;
+  uint64_t header[3], i, batch;
+  long table_pos, end_pos;
+  pthread_t *threads;
+  int t;
+
+  if (nthreads<1) nthreads=1;
+  memset(&z,0,sizeof(ZSection));
+  z.data = (uchar *)data;
+  z.size = size;
+  z.level = level;
+  z.nblocks = (size+ZSECTION_BLOCKSIZE-1)/ZSECTION_BLOCKSIZE;
+  z.csize = (uint64_t *)calloc(z.nblocks+1,sizeof(uint64_t));
+  batch = 4*(uint64_t)nthreads;
+  z.cblocks = (uchar **)calloc(batch,sizeof(uchar *));
+  threads = (pthread_t *)malloc(nthreads*sizeof(pthread_t));
+
+  header[0] = size;
+  header[1] = ZSECTION_BLOCKSIZE;
+  header[2] = z.nblocks;
+  fwrite(header,sizeof(uint64_t),3,fp);
+  /* The table of compressed sizes is written after the blocks are compressed */
+  table_pos = ftell(fp);
+  fwrite(z.csize,sizeof(uint64_t),z.nblocks,fp);
+
+  for (z.first=0; z.first<z.nblocks; z.first=z.last) {
+    z.last = (z.first+batch < z.nblocks) ? z.first+batch : z.nblocks;
+    z.next = z.first;
+    for (t=0; t<nthreads; ++t) pthread_create(threads+t, NULL, compress_blocks, &z);
+    for (t=0; t<nthreads; ++t) pthread_join(threads[t], NULL);
+    if (z.failed) ERROR("write_zsection: could not compress block",1);
+    for (i=z.first; i<z.last; ++i) {
+      if (fwrite(z.cblocks[i-z.first],1,z.csize[i],fp) != z.csize[i]) ERROR("write_zsection: could not write block",1);
+      free(z.cblocks[i-z.first]);
+    }
+  }
+
+  end_pos = ftell(fp);
+  fseek(fp, table_pos, SEEK_SET);
+  fwrite(z.csize,sizeof(uint64_t),z.nblocks,fp);
+  fseek(fp, end_pos, SEEK_SET);
+
+  free(threads);
+  free(z.cblocks);
+  free(z.csize);
+}
+
+
+
+static void *decompress_blocks(void *arg) {
+  ZSection *z = (ZSection *)arg;
+  uint64_t i, max=0;
+  uLongf len;
+  uchar *cblock=NULL;
+  int fd = fileno(z->fp);
+
+  while ( (i = __sync_fetch_and_add(&(z->next),1)) < z->nblocks ) {
+    if (z->csize[i]>max) {
+      max = z->csize[i];
+      cblock = (uchar *)realloc(cblock,max);
+    }
+    if (pread(fd, cblock, z->csize[i], (off_t)z->offset[i]) != (ssize_t)z->csize[i]) { z->failed=1; break; }
+    len = block_length(z,i);
+    if (uncompress(z->data+(size_t)i*ZSECTION_BLOCKSIZE, &len, cblock, z->csize[i]) != Z_OK || len != block_length(z,i)) { z->failed=1; break; }
+  }
+  free(cblock);
+  return NULL;
+}
+
+
+
+/* Read a block-compressed section of size bytes into data.
+   The blocks are read and decompressed by nthreads threads.
+*/
+void read_zsection(FILE *fp, uchar *data, size_t size, int nthreads) {
+  ZSection z;
+  uint64_t header[3], i;
+  pthread_t *threads;
+  int t;
+
+  if (nthreads<1) nthreads=1;
+  if (fread(header,sizeof(uint64_t),3,fp)!=3 || header[0]!=size || header[1]!=ZSECTION_BLOCKSIZE)
+    ERROR("read_zsection: corrupt section in compressed index file",1);
+  memset(&z,0,sizeof(ZSection));
+  z.fp = fp;
+  z.data = data;
+  z.size = size;
+  z.nblocks = header[2];
+  z.csize = (uint64_t *)malloc((z.nblocks+1)*sizeof(uint64_t));
+  z.offset = (uint64_t *)malloc((z.nblocks+1)*sizeof(uint64_t));
+  if (fread(z.csize,sizeof(uint64_t),z.nblocks,fp) != z.nblocks) ERROR("read_zsection: corrupt section in compressed index file",1);
+  z.offset[0] = ftell(fp);
+  for (i=0; i<z.nblocks; ++i) z.offset[i+1] = z.offset[i] + z.csize[i];
+
+  if ((uint64_t)nthreads>z.nblocks) nthreads = (z.nblocks>0) ? (int)z.nblocks : 1;
+  threads = (pthread_t *)malloc(nthreads*sizeof(pthread_t));
+  for (t=0; t<nthreads; ++t) pthread_create(threads+t, NULL, decompress_blocks, &z);
+  for (t=0; t<nthreads; ++t) pthread_join(threads[t], NULL);
+  if (z.failed) ERROR("read_zsection: could not read or decompress block of compressed index file",1);
+
+  fseek(fp, (long)z.offset[z.nblocks], SEEK_SET);
+
+  free(threads);
+  free(z.offset);
+  free(z.csize);
+}
@@ -0,0 +1,32 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+#ifndef BLOCKZ_h
+#define BLOCKZ_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+/*
+  Block-compressed sections of index files.
+
+  A section of size bytes is split into blocks of ZSECTION_BLOCKSIZE bytes,
+  which are compressed independently with zlib, such that they can be
+  compressed and decompressed by several threads. When reading, each thread
+  reads its compressed blocks from the file by itself and decompresses them
+  directly into their place in memory.
+
+  Layout of a section:
+     size (uint64) | block size (uint64) | number of blocks n (uint64) |
+     compressed size of each block (n x uint64) | compressed blocks
+*/
+
+#define ZSECTION_BLOCKSIZE (1<<22)
+
+
+/* FUNCTION PROTOTYPES BEGIN  ( by funcprototypes.pl ) */
+void write_zsection(FILE *fp, const uchar *data, size_t size, int level, int nthreads);
+void read_zsection(FILE *fp, uchar *data, size_t size, int nthreads);
+/* FUNCTION PROTOTYPES END */
+
+#endif
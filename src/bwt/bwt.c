@@ -5,11 +5,13 @@
 #include <string.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <sys/mman.h>
 
 #include "common.h"
 #include "bwt.h"
 #include "fmi.h"
 #include "suffixArray.h"
+#include "blockz.h"
 
 
 
@@ -88,6 +90,84 @@ BWT *readIndexes(FILE *fp) {
 }
 
 
+/*
+	 Block-compressed index files (made by compressfmi) start with this magic
+	 instead of the BWT length. The BWT, SA and FMI checkpoints are stored as
+	 block-compressed sections, see blockz.h
+	 */
+static const char index_blocks_magic[8] = {'K','A','I','J','U','F','Z','1'};
+
+
+/*
+	 Return 1 if the file is a block-compressed index and skip the magic,
+	 otherwise return 0 and rewind to the start of the file
+	 */
+int isBlockCompressedIndex(FILE *fp) {
+	char magic[8];
+	if (fread(magic,sizeof(char),8,fp)==8 && memcmp(magic,index_blocks_magic,8)==0) return 1;
+	rewind(fp);
+	return 0;
+}
+
+
+/*
+	 Read indexes from a block-compressed file after isBlockCompressedIndex(),
+	 using nthreads threads for reading and decompressing
+	 */
+BWT *readIndexesBlocks(FILE *fp, int nthreads) {
+	BWT *b=read_BWT_header(fp);
+
+	b->bwt=NULL;
+
+	b->s = read_suffixArray_header(fp);
+	b->s->sa = (uchar *)malloc(suffixArray_body_size(b->s));
+	read_zsection(fp, b->s->sa, suffixArray_body_size(b->s), nthreads);
+	b->f = read_fmi_blocks(fp, nthreads);
+
+	return b;
+}
+
+
+/*
+	 Write indexes into a block-compressed file with zlib compression level
+	 and nthreads threads
+	 */
+void writeIndexesBlocks(BWT *b, FILE *fp, int level, int nthreads) {
+	fwrite(index_blocks_magic,sizeof(char),8,fp);
+	write_BWT_header(b, fp);
+	write_suffixArray_header(b->s, fp);
+	write_zsection(fp, b->s->sa, suffixArray_body_size(b->s), level, nthreads);
+	write_fmi_blocks(b->f, fp, level, nthreads);
+}
+
+
+/*
+	 Read indexes from one file (made by mkfmi), but only load the parts needed
+	 for searching (BWT and FMI checkpoints) into memory. The SA checkpoints are
+	 only needed for locating matches and are memory-mapped from the file.
+	 If lock_hot is set, the loaded parts are locked in RAM, so that they are
+	 not paged out in favour of the mapped SA.
+	 */
+BWT *readIndexesTiered(FILE *fp, int lock_hot) {
+	long sa_offset;
+	BWT *b=read_BWT_header(fp);
+
+	b->bwt=NULL;
+
+	b->s = read_suffixArray_header(fp);
+	sa_offset = ftell(fp);
+	fseek(fp, suffixArray_body_size(b->s), SEEK_CUR);
+	b->f = read_fmi(fp);
+
+	// Lock before mapping the SA, which should stay pageable
+	if (lock_hot && mlockall(MCL_CURRENT)!=0)
+		fprintf(stderr,"Warning: Could not lock index in memory, check the limit for locked memory (ulimit -l).\n");
+	map_suffixArray_body(b->s, fp, sa_offset);
+
+	return b;
+}
+
+
 
 
 
@@ -121,6 +201,45 @@ void get_suffix(FMI *fmi, suffixArray *s, IndexType i, int *iseq, IndexType *pos
 }
 
 
+/* Incremental version of get_suffix for interleaving several lookups.
+	 Each call of get_suffix_step does one step of the lookup and prefetches the
+	 memory needed by the next step, which is then read while other lookups proceed.
+	 Returns 0 when the lookup is finished and *iseq and *pos are set.
+	 */
+static inline void prefetch_suffix(FMI *fmi, suffixArray *s, SuffixLookup *l) {
+	if ( l->c && (l->i & s->check) ) FMIprefetch(fmi, l->i);
+	else if (l->c) {
+		long k = (l->i>>s->chpt_exp)-((s->nseq-1)>>s->chpt_exp)-1;
+		if (s->nbytes) __builtin_prefetch(s->sa + k * s->nbytes);
+		else __builtin_prefetch(s->sa + ((k * s->nbits)>>3));
+	}
+}
+
+void get_suffix_start(FMI *fmi, suffixArray *s, IndexType i, SuffixLookup *l) {
+	l->i = i;
+	l->k = 0;
+	l->c = 1;
+	prefetch_suffix(fmi, s, l);
+}
+
+int get_suffix_step(FMI *fmi, suffixArray *s, SuffixLookup *l, int *iseq, IndexType *pos) {
+	if ( l->c && (l->i & s->check) ) {
+		l->i = FMindexCurrent(fmi,&l->c,l->i);
+		++l->k;
+		prefetch_suffix(fmi, s, l);
+		return 1;
+	}
+
+	if (l->c) {
+		suffixArray_decode_number(iseq, pos,
+				(l->i>>s->chpt_exp)-((s->nseq-1)>>s->chpt_exp)-1, s);
+		*pos += l->k;
+	}
+	else { *iseq = l->i; *pos=l->k-1; }
+	return 0;
+}
+
+
 /*
 	 Reconstruct sequence number snum (according to the original order of the sequence file)
 	 */
@@ -381,3 +500,114 @@ SI *greedyExact(FMI *f, char *str, int len, int L, int jump) {
 
 
 
+/* Incremental versions of maxMatches, maxMatches_withStart and greedyExact for interleaving the searches of
+	 several queries. Each call of matchSearch_step extends the current match by one letter and prefetches the
+	 FM index checkpoints of both ends of the new suffix interval, which are needed by the next step.
+	 Returns 0 when the search is finished, then the matches are in m->first as returned by the other functions.
+	 */
+static inline void prefetch_extension(FMI *f, MatchSearch *m) {
+	if (m->i > 0) {
+		FMIprefetch(f, m->si[0]);
+		FMIprefetch(f, m->si[1]);
+	}
+}
+
+/* Start a new match ending at j */
+static void match_begin(FMI *f, MatchSearch *m) {
+	m->i = m->j;
+	InitialSI(f, m->str[m->i], m->si);
+	prefetch_extension(f, m);
+}
+
+/* Record the match str[i..j] like the loop bodies of maxMatches and greedyExact and move on to the next end j */
+static void match_end(MatchSearch *m) {
+	IndexType l = m->j - m->i + 1;
+	int k;
+
+	if (m->kind == MATCHSEARCH_WITHSTART) {
+		if (l>=m->L) m->first = alloc_SI(m->si, m->i, l);
+		m->done = 1;
+		return;
+	}
+	if (m->kind == MATCHSEARCH_MAXMATCHES) {
+		if (l>=m->L && ( !m->cur || m->i < m->cur->qi )) {
+			m->cur = alloc_SI(m->si, m->i, l);
+			m->first = insert_SI_sorted(m->first, m->cur);
+			if (m->max_matches>0) {
+				k = free_until_max_SI(m->first, m->max_matches);
+				if (k>m->L) m->L=k;
+				if (l<k) m->cur=NULL;
+			}
+		}
+	}
+	else if (l>=m->L) {
+		if (l>m->L) {
+			recursive_free_SI(m->first);
+			m->first = NULL;
+			m->L=l;
+			if (m->jump>=0) m->delta=m->L-m->jump;
+		}
+		m->cur = m->first;
+		m->first = alloc_SI(m->si, m->i, l);
+		m->first->samelen=m->cur;
+	}
+	if (m->i<=1) { m->done = 1; return; }
+	m->j -= m->delta;
+	if (m->j < m->L-1) m->done = 1;
+}
+
+void maxMatches_start(FMI *f, MatchSearch *m, char *str, int len, int L, int max_matches) {
+	m->kind = MATCHSEARCH_MAXMATCHES;
+	m->str = str;
+	m->len = len;
+	m->L = L;
+	m->max_matches = max_matches;
+	m->delta = 1;
+	m->first = m->cur = NULL;
+	m->j = len-1;
+	m->done = m->j < L-1;
+	if (!m->done) match_begin(f, m);
+}
+
+void maxMatches_withStart_start(FMI *f, MatchSearch *m, char *str, int len, int L, IndexType si0, IndexType si1, int offset) {
+	m->kind = MATCHSEARCH_WITHSTART;
+	m->str = str;
+	m->len = len;
+	m->L = L;
+	m->first = m->cur = NULL;
+	m->j = len-1;
+	m->i = m->j-offset+1;
+	m->si[0] = si0;
+	m->si[1] = si1;
+	m->done = 0;
+	prefetch_extension(f, m);
+}
+
+void greedyExact_start(FMI *f, MatchSearch *m, char *str, int len, int L, int jump) {
+	m->kind = MATCHSEARCH_GREEDYEXACT;
+	m->str = str;
+	m->len = len;
+	m->L = L;
+	m->jump = jump;
+	m->delta = (jump>=0) ? L-jump : 1;
+	m->first = m->cur = NULL;
+	m->j = len-1;
+	m->done = m->j < L-1;
+	if (!m->done) match_begin(f, m);
+}
+
+int matchSearch_step(FMI *f, MatchSearch *m) {
+	if (m->done) return 0;
+	if (m->i > 0 && UpdateSI(f, m->str[m->i-1], m->si, NULL) != 0) {
+		m->i--;
+		prefetch_extension(f, m);
+		return 1;
+	}
+	match_end(m);
+	if (m->done) return 0;
+	match_begin(f, m);
+	return 1;
+}
+
+
+
@@ -34,12 +34,47 @@ typedef struct _SI_ {
 } SI;
 
 
+/* State of a suffix array lookup by get_suffix_start() and get_suffix_step() */
+typedef struct {
+  IndexType i;
+  IndexType k;
+  uchar c;
+} SuffixLookup;
+
+
+/* State of a search for maximal matches by maxMatches_start(), maxMatches_withStart_start() or
+   greedyExact_start() and matchSearch_step(), which extends the current match by one letter per step */
+typedef struct {
+  int kind;         // MATCHSEARCH_MAXMATCHES, MATCHSEARCH_WITHSTART or MATCHSEARCH_GREEDYEXACT
+  char *str;
+  int len;
+  int L;            // Minimum match length, which is raised during the search
+  int max_matches;  // See maxMatches()
+  int jump;         // See greedyExact()
+  int delta;
+  int i, j;         // str[i..j] is matched by the suffix interval si
+  IndexType si[2];
+  SI *first, *cur;  // Found matches
+  int done;
+} MatchSearch;
+
+#define MATCHSEARCH_MAXMATCHES 0
+#define MATCHSEARCH_WITHSTART 1
+#define MATCHSEARCH_GREEDYEXACT 2
+
+
 
 /* FUNCTION PROTOTYPES BEGIN  ( by funcprototypes.pl ) */
 void write_BWT_header(BWT *b, FILE *bwtfile);
 BWT *read_BWT(FILE *bwtfile);
 BWT *readIndexes(FILE *fp);
+int isBlockCompressedIndex(FILE *fp);
+BWT *readIndexesBlocks(FILE *fp, int nthreads);
+void writeIndexesBlocks(BWT *b, FILE *fp, int level, int nthreads);
+BWT *readIndexesTiered(FILE *fp, int lock_hot);
 void get_suffix(FMI *fmi, suffixArray *s, IndexType i, int *iseq, IndexType *pos);
+void get_suffix_start(FMI *fmi, suffixArray *s, IndexType i, SuffixLookup *l);
+int get_suffix_step(FMI *fmi, suffixArray *s, SuffixLookup *l, int *iseq, IndexType *pos);
 uchar *retrieve_seq(int snum, BWT *b);
 IndexType InitialSI(FMI *f, uchar ct, IndexType *si);
 IndexType UpdateSI(FMI *f, uchar ct, IndexType *si, IndexType *newsi);
@@ -47,6 +82,10 @@ void recursive_free_SI(SI *si);
 SI *maxMatches(FMI *f, char *str, int len, int L, int max_matches);
 SI *maxMatches_withStart(FMI *f, char *str, int len, int L, int max_matches, IndexType si0, IndexType si1, int offset);
 SI *greedyExact(FMI *f, char *str, int len, int L, int jump);
+void maxMatches_start(FMI *f, MatchSearch *m, char *str, int len, int L, int max_matches);
+void maxMatches_withStart_start(FMI *f, MatchSearch *m, char *str, int len, int L, IndexType si0, IndexType si1, int offset);
+void greedyExact_start(FMI *f, MatchSearch *m, char *str, int len, int L, int jump);
+int matchSearch_step(FMI *f, MatchSearch *m);
 /* FUNCTION PROTOTYPES END */
 
 #endif
@@ -34,12 +34,14 @@
 #include <stdlib.h>
 
 #include "compactfmi.h"
+#include "blockz.h"
 
 // #define TESTING
 
 #define ex2 8    // Exponent for checkpoints index 2 (ex2<ex1!!)
 
 #include "fmicommon.h"
+#include "phasetime.h"
 
 
 /*
@@ -65,26 +67,27 @@
 */
 
 
-static uchar lcode[256];
-static uchar ncode[256];
+/* The decoding tables depend on the letter frequencies of each BWT, so they are
+   kept in the FMI, which allows using several indexes in the same program */
+static inline uchar fmi_decode_letter(const FMI *f, uchar code) { return f->lcode[code]; }
+static inline uchar fmi_decode_number(const FMI *f, uchar code) { return f->ncode[code]; }
 
-static inline uchar fmi_decode_letter(uchar code) { return lcode[code]; }
-static inline uchar fmi_decode_number(uchar code) { return ncode[code]; }
 
-
-static void fmi_fill_codes(int alen, int *startLcode) {
+static void fmi_fill_codes(FMI *f) {
   int a, n, k;
+  const int alen = f->alen;
+  const int *startLcode = f->startLcode;
 
   // for (a=0;a<alen+1;++a) fprintf(stderr,"fmi_fill_codes %d %d\n",a,startLcode[a]);
 
   for (a=0;a<alen;++a) {
     n=0;
     for (k=startLcode[a]; k<startLcode[a+1]-1; ++k) {
-      lcode[k]=a;
-      ncode[k]=n++;
+      f->lcode[k]=a;
+      f->ncode[k]=n++;
     }
-    lcode[k]=a;
-    ncode[k]=255;
+    f->lcode[k]=a;
+    f->ncode[k]=255;
   }
 }
 
@@ -155,7 +158,7 @@ static int *find_startLcode(const int alen, const uchar *bwt, const IndexType bl
 FMI *alloc_FMI(uchar *bwt, IndexType bwtlen, int alen) {
   FMI *f = alloc_FMI_common(bwt, bwtlen, alen, sizeof(ushort));
   f->startLcode = find_startLcode(alen, bwt, bwtlen);
-  fmi_fill_codes(alen,f->startLcode);
+  fmi_fill_codes(f);
   return f;
 }
 
@@ -166,7 +169,7 @@ FMI *read_fmi(FILE *fp) {
   FMI *f = read_fmi_common(sizeof(ushort),fp);
   f->startLcode = (int *)malloc((f->alen+1)*sizeof(int));
   fread(f->startLcode,sizeof(int),f->alen+1,fp);
-  fmi_fill_codes(f->alen,f->startLcode);
+  fmi_fill_codes(f);
   return f;
 }
 
@@ -181,6 +184,71 @@ void write_fmi(const FMI *f, FILE *fp) {
 
 
 
+/* Read the FMI from a block-compressed index file, see blockz.h.
+   The checkpoints of index1 and index2 are each decompressed into one
+   contiguous array, which the row pointers point into.
+*/
+FMI *read_fmi_blocks(FILE *fp, int nthreads) {
+  int i;
+  IndexType *index1;
+  ushort *index2;
+  FMI *f = (FMI *)malloc(sizeof(FMI));
+
+  fread(&(f->alen),sizeof(int),1,fp);
+  fread(&(f->bwtlen),sizeof(IndexType),1,fp);
+  fread(&(f->N1),sizeof(int),1,fp);
+  fread(&(f->N2),sizeof(int),1,fp);
+
+  f->bwt=(uchar *)malloc(f->bwtlen*sizeof(uchar));
+  read_zsection(fp, f->bwt, f->bwtlen*sizeof(uchar), nthreads);
+
+  index1 = (IndexType *)malloc((size_t)f->N1*f->alen*sizeof(IndexType));
+  read_zsection(fp, (uchar *)index1, (size_t)f->N1*f->alen*sizeof(IndexType), nthreads);
+  f->index1 = (IndexType **)malloc(f->N1*sizeof(IndexType *));
+  for (i=0;i<f->N1;++i) f->index1[i] = index1 + (size_t)i*f->alen;
+
+  index2 = (ushort *)malloc((size_t)f->N2*f->alen*sizeof(ushort));
+  read_zsection(fp, (uchar *)index2, (size_t)f->N2*f->alen*sizeof(ushort), nthreads);
+  f->index2 = (ushort **)malloc(f->N2*sizeof(ushort *));
+  for (i=0;i<f->N2;++i) f->index2[i] = index2 + (size_t)i*f->alen;
+
+  f->startLcode = (int *)malloc((f->alen+1)*sizeof(int));
+  fread(f->startLcode,sizeof(int),f->alen+1,fp);
+  fmi_fill_codes(f);
+  return f;
+}
+
+
+
+
+/* Write the FMI to a block-compressed index file */
+void write_fmi_blocks(const FMI *f, FILE *fp, int level, int nthreads) {
+  int i;
+  uchar *rows;
+
+  fwrite(&(f->alen),sizeof(int),1,fp);
+  fwrite(&(f->bwtlen),sizeof(IndexType),1,fp);
+  fwrite(&(f->N1),sizeof(int),1,fp);
+  fwrite(&(f->N2),sizeof(int),1,fp);
+
+  write_zsection(fp, f->bwt, f->bwtlen*sizeof(uchar), level, nthreads);
+
+  rows = (uchar *)malloc((size_t)f->N1*f->alen*sizeof(IndexType));
+  for (i=0;i<f->N1;++i) memcpy(rows+(size_t)i*f->alen*sizeof(IndexType), f->index1[i], f->alen*sizeof(IndexType));
+  write_zsection(fp, rows, (size_t)f->N1*f->alen*sizeof(IndexType), level, nthreads);
+  free(rows);
+
+  rows = (uchar *)malloc((size_t)f->N2*f->alen*sizeof(ushort));
+  for (i=0;i<f->N2;++i) memcpy(rows+(size_t)i*f->alen*sizeof(ushort), f->index2[i], f->alen*sizeof(ushort));
+  write_zsection(fp, rows, (size_t)f->N2*f->alen*sizeof(ushort), level, nthreads);
+  free(rows);
+
+  fwrite(f->startLcode,sizeof(int),f->alen+1,fp);
+}
+
+
+
+
 /***********************************************
  *
  * Querying FMI
@@ -198,15 +266,15 @@ void write_fmi(const FMI *f, FILE *fp) {
    will count in order to return the correct FMI value
    Note that it return the number*direction (negative for forward search)
 */
-static inline int fmi_bwt2number(const uchar c, uchar *bwt, const int direction) {
+static inline int fmi_bwt2number(const FMI *f, const uchar c, uchar *bwt, const int direction) {
   int n, k=0;
 
   /* Search if n==255  */
-  while ( ( n = fmi_decode_number(*bwt) ) ==255 ) {
+  while ( ( n = fmi_decode_number(f, *bwt) ) ==255 ) {
     k += 1;
     /* Find next letter equal to c */
     bwt+=direction;
-    while ( fmi_decode_letter(*bwt) != c) bwt+=direction;
+    while ( fmi_decode_letter(f, *bwt) != c) bwt+=direction;
   }
 
   if (direction <0) return n+k;
@@ -246,9 +314,9 @@ static inline int fmi_chpt_difference(FMI *f, IndexType k, uchar c, int directio
   Stop if bound is reached
   Returns NULL if letter is NOT found
 */
-static inline uchar *find_closest_letter_with_bound(const uchar ct, uchar *bwt,
+static inline uchar *find_closest_letter_with_bound(const FMI *f, const uchar ct, uchar *bwt,
 				       const int dir, const uchar *bound) {
-  while ( ct != fmi_decode_letter(*bwt) ) {
+  while ( ct != fmi_decode_letter(f, *bwt) ) {
     if (bwt == bound) { return NULL; }
     bwt += dir;
   }
@@ -270,7 +338,7 @@ IndexType FMindex(FMI *f, uchar ct, IndexType k) {
   IndexType fmi, delta=0;
 
   bwt = f->bwt+k;
-  if (k<f->bwtlen) c = fmi_decode_letter(*bwt);
+  if (k<f->bwtlen) c = fmi_decode_letter(f, *bwt);
   else c=255;
   direction=fmi_direction(k);
 
@@ -296,12 +364,12 @@ IndexType FMindex(FMI *f, uchar ct, IndexType k) {
       else delta=1;
 
       if (bwt==bwtstop) bwt=NULL;
-      else bwt = find_closest_letter_with_bound(ct, bwt+direction, direction, bwtstop);
+      else bwt = find_closest_letter_with_bound(f, ct, bwt+direction, direction, bwtstop);
     }
   }
 
   /* If letter is encountered, add proper value */
-  if (bwt) fmi += delta + fmi_bwt2number(ct, bwt, direction);
+  if (bwt) fmi += delta + fmi_bwt2number(f, ct, bwt, direction);
 
   return fmi;
 }
@@ -316,7 +384,7 @@ static IndexType FMindexHere(const FMI *f, uchar *bwt, const uchar c, const Inde
   direction=fmi_direction(k);
 
   // Get number
-  n = fmi_bwt2number(c, bwt, direction);
+  n = fmi_bwt2number(f, c, bwt, direction);
 
   return n + fmi_chpt_value_with_dir(f, k, c, direction);
 }
@@ -330,13 +398,23 @@ IndexType FMindexCurrent(FMI *f, uchar *c, IndexType k) {
 
   // Read letter
   bwt = f->bwt + k;
-  *c = fmi_decode_letter(*bwt);
+  *c = fmi_decode_letter(f, *bwt);
 
   return FMindexHere(f,bwt,*c,k);
 }
 
 
 
+/* Prefetch the BWT letter and checkpoint at position k, which are read by FMindexCurrent */
+void FMIprefetch(FMI *f, IndexType k) {
+  IndexType chpt2 = k>>ex2;
+  if (fmi_direction(k)>0) chpt2 += 1;
+  __builtin_prefetch(f->bwt + k);
+  __builtin_prefetch(f->index2[chpt2]);
+}
+
+
+
 /* Return the FMI value for all letters at position k
    Search for closest from (and including) current position k
    and return the fmi value.
@@ -361,12 +439,11 @@ void FMindexAll(FMI *f, IndexType k, IndexType *fmia) {
   if ( direction>0 && nleft > f->bwtlen-k) nleft = f->bwtlen-k;
 
   while ( nleft>0 ) {
-    c = fmi_decode_letter(*bwt);
-    if (c==0) break;
+    c = fmi_decode_letter(f, *bwt);
     // k+=direction;  // only for debug
     // DPRINT("nleft=%d k=%ld dist chkpt=%d c=%d fmi=%ld ",nleft,k,(int)(k-(k&round2)),c,fmia[c] );
     if ( fmia[c]>=size2 ) {
-      n = fmi_decode_number(*bwt);
+      n = fmi_decode_number(f, *bwt);
       if (n<255) {           // Letter count found
 	n += fmia[c]-size2+1;
 	if (direction<0) fmia[c] = n;
@@ -445,9 +522,15 @@ void FMIrecode(FMI *fmi) {
 */
 FMI *makeIndex(uchar *bwt, long bwtlen, int alen) {
   FMI *fmi;
+  double t;
 
+  t = wall_time();
   fmi = makeIndex_common(bwt, bwtlen, alen);
+  fprintf(stderr,"\n");
+  print_phase_time("makeIndex_common",wall_time()-t);
+  t = wall_time();
   FMIrecode(fmi);
+  print_phase_time("FMIrecode",wall_time()-t);
   return fmi;
 }
 
@@ -15,6 +15,8 @@ typedef struct {
   IndexType **index1; // FM index1 (one array per letter)
   ushort **index2;    // Counts relative to index1 checkpoints (assuming 16 bit int)
   int *startLcode;    // start numbers for byte encoding of letter and number
+  uchar lcode[256];   // decoding of byte codes into letter and number, filled from startLcode
+  uchar ncode[256];
 } FMI;
 
 
@@ -24,9 +26,12 @@ typedef struct {
 FMI *alloc_FMI(uchar *bwt, IndexType bwtlen, int alen);
 FMI *read_fmi(FILE *fp);
 void write_fmi(const FMI *f, FILE *fp);
+FMI *read_fmi_blocks(FILE *fp, int nthreads);
+void write_fmi_blocks(const FMI *f, FILE *fp, int level, int nthreads);
 IndexType FMindex(FMI *f, uchar ct, IndexType k);
 IndexType FMindexCurrent(FMI *f, uchar *c, IndexType k);
 void FMindexAll(FMI *f, IndexType k, IndexType *fmia);
+void FMIprefetch(FMI *f, IndexType k);
 void FMIrecode(FMI *fmi);
 FMI *makeIndex(uchar *bwt, long bwtlen, int alen);
 FMI *makeIndex_OLD(uchar *bwt, long bwtlen, int alen);
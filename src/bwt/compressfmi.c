@@ -0,0 +1,63 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "fmi.h"
+#include "bwt.h"
+#include "suffixArray.h"
+#include "phasetime.h"
+
+static void usage(char *progname) {
+  fprintf(stderr,"compressfmi converts an index file made by mkfmi into a block-compressed index file,\n");
+  fprintf(stderr,"which is decompressed in parallel when it is loaded.\n\n");
+  fprintf(stderr,"Usage:\n   %s [-n INT] [-l INT] <input.fmi> <output.fmi>\n\n",progname);
+  fprintf(stderr,"   -n INT   Number of threads for compression (default: 1)\n");
+  fprintf(stderr,"   -l INT   zlib compression level from 1 (fastest) to 9 (smallest) (default: 6)\n");
+  exit(1);
+}
+
+
+int main (int argc, char **argv) {
+  int c, nthreads=1, level=6;
+  FILE *fp;
+  BWT *b;
+  double t_start, t;
+
+  while ((c = getopt(argc, argv, "hn:l:")) != -1) {
+    switch (c) {
+      case 'n': nthreads = atoi(optarg); break;
+      case 'l': level = atoi(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (argc-optind != 2 || nthreads<1 || level<1 || level>9) usage(argv[0]);
+
+  t_start = t = wall_time();
+
+  fp = fopen(argv[optind],"r");
+  if (!fp) { fprintf(stderr,"ERROR: File %s could not be opened for reading\n",argv[optind]); exit(1); }
+  if (isBlockCompressedIndex(fp)) { fprintf(stderr,"ERROR: File %s is already compressed\n",argv[optind]); exit(1); }
+  fprintf(stderr,"Reading index from file %s ... ",argv[optind]);
+  b = readIndexes(fp);
+  fclose(fp);
+  fprintf(stderr,"DONE\n");
+  fprintf(stderr,"BWT of length %ld has been read with %d sequences, alphabet=%s\n", b->len, b->nseq, b->alphabet);
+  print_phase_time("read_index",wall_time()-t);
+  t=wall_time();
+
+  fp = fopen(argv[optind+1],"w");
+  if (!fp) { fprintf(stderr,"ERROR: File %s could not be opened for writing\n",argv[optind+1]); exit(1); }
+  fprintf(stderr,"Writing compressed index to file %s ... ",argv[optind+1]);
+  writeIndexesBlocks(b, fp, level, nthreads);
+  if (ferror(fp) || fclose(fp)!=0) { fprintf(stderr,"ERROR: Could not write to file %s\n",argv[optind+1]); exit(1); }
+  fprintf(stderr,"DONE\n");
+  print_phase_time("write_compressed",wall_time()-t);
+  print_phase_time("total",wall_time()-t_start);
+  print_peak_rss();
+
+  return 0;
+}
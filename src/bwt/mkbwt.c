@@ -27,9 +27,6 @@ gcc -g -o sufSort -l pthread sufSort.c
 
 */
 
-// Use multikey quick sort
-#define MKQS
-
 // Use repeat sorting (not necessary with MKQS -?)
 #define REPSORT
 
@@ -71,12 +68,24 @@ gcc -g -o sufSort -l pthread sufSort.c
 #include "readFasta.h"
 #include "mkbwt_vars.h"
 #include "suffixArray.h"
+#include "phasetime.h"
 
 
 
 /* Global var for setting of number for worker */
 int workerNum=0;
 
+/* Time spent by all workers in each phase (summed over threads) */
+#define PHASE_FILL 0
+#define PHASE_SORT 1
+#define PHASE_BWT 2
+#define PHASE_SAWRITE 3
+#define PHASE_BWTWRITE 4
+#define NPHASES 5
+static char *phase_names[NPHASES] = {"fill_buckets","sort_buckets","bucket_bwt","write_sa_checkpoints","write_bwt"};
+static double phase_time[NPHASES];
+static pthread_mutex_t phase_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 /* Status flags */
 #define UNINIT 0
@@ -94,9 +103,10 @@ typedef struct {
   int wn;       /* prefix (word) number */
   int jump;     /* =wlen except for words with terminator for which it is the dist to term */
   char *word;   /* prefix (word) */
-  char **sa;    /* Suffixes which needs to be sorted (pointers to *seq) */
-  char **cur;   /* Current suffix */
+  uchar *sa;    /* Suffixes which needs to be sorted (offsets into *seq, see suffix_offset_get) */
+  long cur;     /* Current suffix */
   long len;     /* Length of sa to be sorted */
+  int width;    /* Bytes per offset in sa */
   int alen;     /* Length of alphabet */
   char *alphabet; /* Alphabet */
   long slen;    /* Length of the whole sequence */
@@ -224,7 +234,8 @@ Bucket *allocBucket(long slen, char *seq, int wlen, int wn, int alen,
   number2word(wn,alen,bucket->word,wlen,alphabet);
   bucket->len=bucket_size;
   bucket->sa=NULL;
-  bucket->cur=NULL;
+  bucket->cur=0;
+  bucket->width=suffix_offset_width(slen);
   bucket->alen=alen;
   bucket->alphabet=alphabet;
   bucket->slen=slen;
@@ -348,9 +359,10 @@ void fillBuckets(BucketStack *bs, int istart, int m) {
 
   /* alloc buckets  */
   for (i=istart; i<iend; ++i) {
+    bucket[i]->cur = 0;
     if (bucket[i]->len)
-      bucket[i]->sa = bucket[i]->cur = (char **)malloc(bucket[i]->len*sizeof(char *));
-    else bucket[i]->sa = bucket[i]->cur = NULL;
+      bucket[i]->sa = (uchar *)malloc(bucket[i]->len*bucket[i]->width);
+    else bucket[i]->sa = NULL;
   }
 
   /* Fill buckets */
@@ -360,7 +372,7 @@ void fillBuckets(BucketStack *bs, int istart, int m) {
     if (*seq>0 ) {
       i=word_number(seq,bs->wlen,bs->alen);
       if (i>=istart && i<iend) {
-	*(bucket[i]->cur) = seq+bucket[i]->jump;
+	suffix_offset_set(bucket[i]->sa, bucket[i]->cur, bucket[i]->width, (long)(seq-bs->seq)+bucket[i]->jump);
 	bucket[i]->cur += 1;
       }
     }
@@ -392,10 +404,10 @@ static inline int compare_strings(const void *str1, const void *str2) {
   long repeats of the same letter (such as Ns in genomes) are extremely
   slow to sort. This function takes care of such repeats
  */
-void repeatSuffixSort(char **s, int l, char a, int jump) {
+void repeatSuffixSort(uchar *s, int w, const char *seq, int l, char a, int jump) {
   int clow, chigh;
   int count;
-  char *tmp, **test, **low, **high, *limit;
+  long tmp, test, low, high, limit;
 
   // fprintf(stderr,"repeatSuffixSort %d\n",a);
 
@@ -405,54 +417,50 @@ void repeatSuffixSort(char **s, int l, char a, int jump) {
      "back-propagation" of those suffixes starting with a letter != a
      (here a suffix is the suffix coming after the word that defines the bucket)
   */
-  test = low = s;
-  high = s+l-1;
-  limit = *s;           // Limit is the lowest pointer value encluntered
+  /* test, low and high are indices into s, tmp and limit are offsets into seq */
+  test = low = 0;
+  high = l-1;
+  limit = suffix_offset_get(s,0,w);   // Limit is the lowest offset encountered
   while (test<=high) {
-    if (*test<limit) limit = *test;
-    if (**test<a) { *low = *test; ++low; ++test; }
+    long t = suffix_offset_get(s,test,w);
+    if (t<limit) limit = t;
+    if (seq[t]<a) { suffix_offset_set(s,low,w,t); ++low; ++test; }
     else {
-      if (**test>a) {
-	tmp = *high;
-	*high = *test;
+      if (seq[t]>a) {
+	suffix_offset_set(s,test,w,suffix_offset_get(s,high,w));
+	suffix_offset_set(s,high,w,t);
 	--high;
-	*test = tmp;
       }
       else ++test;
     }
   }
-  clow = (int)(low-s);
-  chigh = (int)(s+l-high-1);
+  clow = (int)low;
+  chigh = (int)(l-high-1);
   limit -= jump;
 
   /* Now sort the high and low intervals */
-#ifdef MKQS
-  multikeyqsort(s,clow);
-  multikeyqsort(s+l-chigh,chigh);
-#else
-  qsort(s,clow,sizeof(char*),compare_strings);
-  qsort(s+l-chigh,chigh,sizeof(char*),compare_strings);
-#endif
+  multikeyqsort(s,w,seq,clow);
+  multikeyqsort(s+(long)(l-chigh)*w,w,seq,chigh);
 
   if (clow+chigh<l) {
     /* Now "backpropagate" low results */
     count = clow;
-    low = s+clow;
-    test = s;
+    low = clow;
+    test = 0;
     while (count) {
-      tmp = *test-jump-1;
-      if (tmp>=limit && *tmp==a) { *low = *test-1; ++low; }
+      tmp = suffix_offset_get(s,test,w)-jump-1;
+      if (tmp>=limit && seq[tmp]==a) { suffix_offset_set(s,low,w,suffix_offset_get(s,test,w)-1); ++low; }
       else --count;
       ++test;
     }
 
     /* Now "backpropagate" high results */
     count = chigh;
-    high = s+l-chigh-1;
-    test = s+l-1;
+    high = l-chigh-1;
+    test = l-1;
     while (count) {
-      tmp = *test-jump-1;
-      if (tmp>=limit && *tmp==a) { *high = *test-1; --high; }
+      tmp = suffix_offset_get(s,test,w)-jump-1;
+      if (tmp>=limit && seq[tmp]==a) { suffix_offset_set(s,high,w,suffix_offset_get(s,test,w)-1); --high; }
       else --count;
       --test;
     }
@@ -484,20 +492,16 @@ void sortBucket(Bucket *b) {
 
 #ifdef REPSORT
 
-  h = checkHomoPol(b->sa[0],b->wlen);
+  h = checkHomoPol(b->seq+suffix_offset_get(b->sa,0,b->width),b->wlen);
   if (h>0) {
     // fprintf(stderr,"sortBucket: sorting homopolymer %d\n",h);
-    repeatSuffixSort(b->sa, b->len, h, b->wlen);
+    repeatSuffixSort(b->sa, b->width, b->seq, b->len, h, b->wlen);
   }
   else
 #endif
-#ifdef MKQS
-  multikeyqsort(b->sa,b->len);
-#else
-  qsort(b->sa,b->len,sizeof(char*),compare_strings);
-#endif
+  multikeyqsort(b->sa,b->width,b->seq,b->len);
 
-  for (i=0; i<b->len; ++i) b->sa[i]-=b->jump;
+  for (i=0; i<b->len; ++i) suffix_offset_set(b->sa,i,b->width,suffix_offset_get(b->sa,i,b->width)-b->jump);
   b->status=SORTED;
 }
 
@@ -509,7 +513,7 @@ void bwtBucket(Bucket *b) {
 
   if (b->len) {
     b->bwt = malloc(b->len);
-    for (k=0; k<b->len; ++k) b->bwt[k]=*(b->sa[k]-1);
+    for (k=0; k<b->len; ++k) b->bwt[k]=b->seq[suffix_offset_get(b->sa,k,b->width)-1];
   }
   b->status = BWT;
 }
@@ -535,8 +539,8 @@ void bwtWriteBucket(Bucket *b, FILE *bwtfile) {
   if (b->len) {
     int i;
     for (i=0; i<b->len; ++i) {
-      fprintf(stdout,"DEBUG2%8d %4d ", (int)(b->sa[i]-b->seq), b->wn );
-      print_seq(b->seq, b->sa[i], 0, b->slen, DEBUG2, b->alphabet, b->alen, stdout);
+      fprintf(stdout,"DEBUG2%8d %4d ", (int)suffix_offset_get(b->sa,i,b->width), b->wn );
+      print_seq(b->seq, NULL, suffix_offset_get(b->sa,i,b->width), b->slen, DEBUG2, b->alphabet, b->alen, stdout);
     }
   }
   free(b->sa);
@@ -571,6 +575,7 @@ void *BucketSorter(void *x) {
   Bucket *b;
   int i;
   int wn=++workerNum;
+  double t, ptime[NPHASES] = {0.};
 
   DEBUG1LINE(fprintf(stderr,"Worker %d STARTS\n",wn));
 
@@ -593,10 +598,12 @@ void *BucketSorter(void *x) {
       b->status=PROCESS;
       pthread_mutex_unlock(&(bs->lock));
       DEBUG1LINE(fprintf(stderr,"Worker %d: write SA in file for word %d %s\n",wn,b->wn,b->word));
-      write_suffixArray_checkpoints(b->sa, b->start, b->len, bs->sa_struct, bs->safile);
+      t=wall_time();
+      write_suffixArray_checkpoints(b->sa, b->width, b->start, b->len, bs->sa_struct, bs->safile);
       DEBUG1LINE(fprintf(stderr,"Worker %d: write SA in file for word %d %s DONE\n",wn,b->wn,b->word));
       /* Free suffix array */
       free_sa(b);
+      ptime[PHASE_SAWRITE] += wall_time()-t;
       b->status=SAFILE;
       ++(bs->sawrite);
       continue;
@@ -610,7 +617,9 @@ void *BucketSorter(void *x) {
       b->status=PROCESS;
       pthread_mutex_unlock(&(bs->lock));
       DEBUG1LINE(fprintf(stderr,"Worker %d: Write BWT for word %d %s\n",wn,b->wn,b->word));
+      t=wall_time();
       bwtWriteBucket(b,bs->bwtfile);
+      ptime[PHASE_BWTWRITE] += wall_time()-t;
       DEBUG1LINE(fprintf(stderr,"Worker %d: Write BWT for word %d %s DONE\n",wn,b->wn,b->word));
       ++(bs->bwtwrite);
       continue;
@@ -638,7 +647,9 @@ void *BucketSorter(void *x) {
       pthread_mutex_unlock(&(bs->lock));
 
       DEBUG1LINE(fprintf(stderr,"Worker %d: fill buckets for %d..%d\n",wn,fs,fs+fl-1));
+      t=wall_time();
       fillBuckets(bs,fs,fl);
+      ptime[PHASE_FILL] += wall_time()-t;
       DEBUG1LINE(fprintf(stderr,"Worker %d: fill buckets for %d..%d DONE\n",wn,fs,fs+fl-1));
       pthread_mutex_unlock(&(bs->lock_fill));
       continue;
@@ -657,15 +668,23 @@ void *BucketSorter(void *x) {
     bs->sort += 1;
     pthread_mutex_unlock(&(bs->lock));
     DEBUG1LINE(fprintf(stderr,"Worker %d: sort for word %d %s\n",wn,b->wn,b->word));
+    t=wall_time();
     sortBucket(b);
+    ptime[PHASE_SORT] += wall_time()-t;
     DEBUG1LINE(fprintf(stderr,"Worker %d: sort for word %d %s DONE\n",wn,b->wn,b->word));
     /* Calculate BWT */
     DEBUG1LINE(fprintf(stderr,"Worker %d: Calc BWT for word %d %s\n",wn,b->wn,b->word));
+    t=wall_time();
     bwtBucket(b);
+    ptime[PHASE_BWT] += wall_time()-t;
     DEBUG1LINE(fprintf(stderr,"Worker %d: Calc BWT for word %d %s DONE\n",wn,b->wn,b->word));
 
   }
 
+  pthread_mutex_lock(&phase_lock);
+  for (i=0; i<NPHASES; ++i) phase_time[i] += ptime[i];
+  pthread_mutex_unlock(&phase_lock);
+
   DEBUG1LINE(fprintf(stderr,"Worker %d RETURNS\n",wn));
   return NULL;
 }
@@ -931,8 +950,10 @@ int main(int argc, char **argv) {
   suffixArray *sa_struct;
   int padding=10;          // The zero padding between sequences. Needs to be able to hold seq order
                            // and word length. 10 is more than enough for the first.
+  double t_start, t_phase, t;
 
   print_time(NULL);
+  t_start = t_phase = wall_time();
 
   /* Parsing options and arguments */
   OPT_read_cmdline(opt_struct, argc, argv);
@@ -973,6 +994,9 @@ int main(int argc, char **argv) {
   if (infilename) fclose(fp);
 
   print_time("Sequences read");
+  t=wall_time();
+  print_phase_time("read_fasta",t-t_phase);
+  t_phase=t;
 
   fprintf(stderr,"SLEN %ld\nNSEQ %d\nALPH %s",ss->len,ss->sort_order,alphabet);
   if (astruct->comp) fprintf(stderr," (%s)",astruct->comp);
@@ -1030,8 +1054,9 @@ int main(int argc, char **argv) {
 
   DEBUG1LINE(fprintf(stderr,"Bucket stack initiated\n"));
 
-  /* Number of buckets to fill. Ad hoc at the moment... */
-  wbs->nfill = wbs->nbuckets/20+nThreads;
+  /* Number of buckets to fill. Ad hoc at the moment...
+     The buckets used to hold 8 byte pointers, with the smaller offsets more buckets fit into the same memory */
+  wbs->nfill = (wbs->nbuckets/20)*(int)sizeof(char *)/suffix_offset_width(ss->len)+nThreads;
 
   /* Start nThreads-1 to begin with */
   pthread_t *worker = (pthread_t *)malloc(nThreads*sizeof(pthread_t));
@@ -1042,12 +1067,14 @@ int main(int argc, char **argv) {
   /* Do other work in main thread independent of SA sorting */
 
   /* Do the sorting of seqs */
+  t=wall_time();
   SortSeqs(ss, sa_struct);
   DEBUG1LINE(fprintf(stderr,"Sequences sorted\n"));
 
   /* Write first part of BWT */
   write_term(ss, sa_struct, bwtfile);
   DEBUG1LINE(fprintf(stderr,"BWT for term chars written\n"));
+  print_phase_time("sort_seqs",wall_time()-t);
 
   //sa_struct->seqTermOrder = revSortSeqs(ss, bwtfile);
 
@@ -1076,12 +1103,16 @@ int main(int argc, char **argv) {
     DEBUG1LINE(fprintf(stderr,"Finish bucket for word %s\n",b->word));
     if (b->status == BWT ) {
       /* Write SA checkpoints */
-      write_suffixArray_checkpoints(b->sa, b->start, b->len, wbs->sa_struct, wbs->safile);
+      t=wall_time();
+      write_suffixArray_checkpoints(b->sa, b->width, b->start, b->len, wbs->sa_struct, wbs->safile);
       /* free SA */
       free_sa(b);
+      phase_time[PHASE_SAWRITE] += wall_time()-t;
     }
     /* Write BWT */
+    t=wall_time();
     bwtWriteBucket(b,wbs->bwtfile);
+    phase_time[PHASE_BWTWRITE] += wall_time()-t;
     ++(wbs->bwtwrite);
   }
 
@@ -1091,6 +1122,11 @@ int main(int argc, char **argv) {
   fclose(sa_file);
 
   print_time("Sorting done, ");
+  t=wall_time();
+  print_phase_time("buckets",t-t_phase);
+  for (i=0; i<NPHASES; ++i) print_phase_time(phase_names[i],phase_time[i]);
+  print_phase_time("total",t-t_start);
+  print_peak_rss();
 
   /* Free a lot of stuf.... */
 
@@ -10,6 +10,7 @@
 #include "bwt.h"
 #include "suffixArray.h"
 #include "mkfmi_vars.h"
+#include "phasetime.h"
 
 void error(char *format, char *arg) {
   fprintf(stderr,"ERROR: ");
@@ -23,6 +24,7 @@ int main (int argc, char **argv) {
   FILE *fp=NULL;
   BWT *b;
   char *filename;
+  double t_start, t;
 
   /* Parsing options and arguments */
   OPT_read_cmdline(opt_struct, argc, argv);
@@ -34,6 +36,8 @@ int main (int argc, char **argv) {
     exit(5);
   }
 
+  t_start = t = wall_time();
+
   l=strlen(filenm);
   filename = (char *)malloc((l+10)*sizeof(char));
   strcpy(filename,filenm);
@@ -48,6 +52,8 @@ int main (int argc, char **argv) {
   fprintf(stderr,"DONE\n");
   fprintf(stderr,"BWT of length %ld has been read with %d sequencs, alphabet=%s\n",
 	  b->len, b->nseq, b->alphabet); 
+  print_phase_time("read_bwt",wall_time()-t);
+  t=wall_time();
 
   /* Read SA */
   strcpy(filename+l,".sa");
@@ -59,6 +65,16 @@ int main (int argc, char **argv) {
   if (b->s->chpt_exp > 0) read_suffixArray_body(b->s,fp);
   fclose(fp);
   fprintf(stderr,"DONE\n");
+  print_phase_time("read_sa",wall_time()-t);
+  t=wall_time();
+
+  /* Store SA checkpoints with sbits+pbits bits per entry instead of whole bytes,
+     which older versions of kaiju cannot read, therefore only with option -pack */
+  if (pack) {
+    suffixArray_pack(b->s);
+    print_phase_time("pack_sa",wall_time()-t);
+    t=wall_time();
+  }
 
   /* Concatenate stuff in fmi file */
   strcpy(filename+l,".fmi");
@@ -68,15 +84,20 @@ int main (int argc, char **argv) {
   write_BWT_header(b, fp);
   write_suffixArray(b->s,fp);
   fprintf(stderr,"DONE\n");
+  print_phase_time("write_sa",wall_time()-t);
 
   fprintf(stderr,"Constructing FM index\n");
   b->f = makeIndex(b->bwt, b->len, b->alen);
-  fprintf(stderr,"\nDONE\n");
+  fprintf(stderr,"DONE\n");
 
   fprintf(stderr,"Writing FM index to file ... ");
+  t=wall_time();
   write_fmi(b->f,fp);
   fclose(fp);
   fprintf(stderr,"DONE\n");
+  print_phase_time("write_fmi",wall_time()-t);
+  print_phase_time("total",wall_time()-t_start);
+  print_peak_rss();
 
   if (removecmd) {
     int cl = strlen(removecmd);
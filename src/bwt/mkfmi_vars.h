@@ -235,13 +235,16 @@ static int count_filenm=0;
 static char* filenm = NULL;
 static int count_removecmd=0;
 static char* removecmd = NULL;
+static int count_pack=0;
+static int pack = 0;
 static int count_help=0;
 static int help = 0;
 
-static OPT_STRUCT opt_struct[5] = {
+static OPT_STRUCT opt_struct[6] = {
 	{OPTTYPE_SWITCH,VARTYPE_int,NULL,NULL,NULL,"---\nmkfmi is run after mkbwt\n\nmkfmi takes a BWT and calculates the FM index and collects the files\ncontaining the bwt, suffix array and FMI into one file.\n\nExample cmd line\n   mkfmi <filename>\n\nIt will look for <filename>.bwt and <filename>.sa\nOutput in <filename>.bwt (SA and FMI appended to this file)\n\n\nAfter the program has been run, <filename>.sa can be deleted\n\nSee options below\n---\n"},
 	{OPTTYPE_ARG,VARTYPE_charS,(void *)&filenm,&count_filenm,"|filenm|","      Name of index files. Mandatory"},
 	{OPTTYPE_VALUE,VARTYPE_charS,(void *)&removecmd,&count_removecmd,"|removecmd|r|","      Command for deleting .bwt and .sa files (e.g. rm)"},
+	{OPTTYPE_SWITCH,VARTYPE_int,(void *)&pack,(void *)&count_pack,"|pack|p|","      Store SA checkpoints bit-packed. Such index files cannot be read by older versions of kaiju"},
 	{OPTTYPE_SWITCH,VARTYPE_int,(void *)&help,(void *)&count_help,"|help|h|","      Prints summary of options and arguments"},
 	{0,0,NULL,NULL,NULL,NULL}
 };
@@ -9,23 +9,27 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "multikeyqsort.h"
+
 #ifndef min 
 #define min(a, b) ((a)<=(b) ? (a) : (b)) 
 #endif
 
 
-static inline void swap(char *a[], int i, int j) 
-{     char *t = a[i];
-      a[i] = a[j];
-      a[j] = t; 
+/* The array a holds offsets of the suffixes in seq, see suffix_offset_get() */
+
+static inline void swap(uchar *a, int w, int i, int j) 
+{     long t = suffix_offset_get(a, i, w);
+      suffix_offset_set(a, i, w, suffix_offset_get(a, j, w));
+      suffix_offset_set(a, j, w, t); 
 }
-static inline void vecswap(char *a[], int i, int j, int n) 
+static inline void vecswap(uchar *a, int w, int i, int j, int n) 
 {     while (n-- > 0)
-         swap(a, i++, j++); 
+         swap(a, w, i++, j++); 
 }
 
 
-#define ch(i) a[i][depth] 
+#define ch(i) seq[suffix_offset_get(a, i, w)+depth] 
 
 
 /* Faster version */
@@ -37,7 +41,7 @@ static inline int my_strcmp(const char *s1, const char *s2) {
 }
 
 
-static inline int med3func(char *a[], int ia, int ib, int ic, int depth) 
+static inline int med3func(uchar *a, int w, const char *seq, int ia, int ib, int ic, int depth) 
 {   int va, vb, vc;
     if ((va=ch(ia)) == (vb=ch(ib)))
          return ia;
@@ -49,23 +53,23 @@ static inline int med3func(char *a[], int ia, int ib, int ic, int depth)
 } 
 
 
-void inssort(char *a[], int n, int depth) 
+void inssort(uchar *a, int w, const char *seq, int n, int depth) 
 {   int i, j;
     for (i = 1; i < n; i++)
       for (j = i; j > 0; j--) {
-         if (my_strcmp(a[j-1]+depth, a[j]+depth) <= 0)
+         if (my_strcmp(seq+suffix_offset_get(a, j-1, w)+depth, seq+suffix_offset_get(a, j, w)+depth) <= 0)
              break;
-         swap(a, j, j-1);
+         swap(a, w, j, j-1);
       } 
 }  
 
 
-void ssort2(char *a[], int n, int depth) 
+void ssort2(uchar *a, int w, const char *seq, int n, int depth) 
 {    int le, lt, gt, ge, r, v;
      int pl, pm, pn, d;
 
      if (n <= 10) {
-        inssort(a, n, depth);
+        inssort(a, w, seq, n, depth);
         return;
      }
 
@@ -74,42 +78,43 @@ void ssort2(char *a[], int n, int depth)
      pn = n-1;
      if (n > 50) {
         d = n/8;
-        pl = med3func(a, pl, pl+d, pl+2*d,depth);
-        pm = med3func(a, pm-d, pm, pm+d,depth);
-        pn = med3func(a, pn-2*d, pn-d, pn,depth);
+        pl = med3func(a, w, seq, pl, pl+d, pl+2*d,depth);
+        pm = med3func(a, w, seq, pm-d, pm, pm+d,depth);
+        pn = med3func(a, w, seq, pn-2*d, pn-d, pn,depth);
      }
-     pm = med3func(a, pl, pm, pn,depth);
-     swap(a, 0, pm);
+     pm = med3func(a, w, seq, pl, pm, pn,depth);
+     swap(a, w, 0, pm);
      v = ch(0);
      for (le = 1; le < n && ch(le) == v; le++)
        ;  
      if (le == n) {
-         if (v != 0) ssort2(a, n, depth+1);
+         if (v != 0) ssort2(a, w, seq, n, depth+1);
          return;
      }
      lt = le;
      gt = ge = n-1;
      for (;;) {
          for ( ; lt <= gt && ch(lt) <= v; lt++)
-             if (ch(lt) == v) swap(a, le++, lt);
+             if (ch(lt) == v) swap(a, w, le++, lt);
          for ( ; lt <= gt && ch(gt) >= v; gt--) {
-	   if (ch(gt) == v) swap(a, gt, ge--);
+	   if (ch(gt) == v) swap(a, w, gt, ge--);
 	 }
          if (lt > gt)
              break;
-         swap(a, lt++, gt--);
+         swap(a, w, lt++, gt--);
      }
      r = min(le, lt-le);
-     vecswap(a, 0, lt-r, r);
+     vecswap(a, w, 0, lt-r, r);
      r = min(ge-gt, n-ge-1);
-     vecswap(a, lt, n-r, r);
-     ssort2(a, lt-le, depth);
+     vecswap(a, w, lt, n-r, r);
+     ssort2(a, w, seq, lt-le, depth);
      if (v != 0)
-       ssort2(a + lt-le, le + n-ge-1, depth+1);
-     ssort2(a + n-(ge-gt), ge-gt, depth); 
+       ssort2(a + (lt-le)*w, w, seq, le + n-ge-1, depth+1);
+     ssort2(a + (n-(ge-gt))*w, w, seq, ge-gt, depth); 
 }
 
 
 //void ssort2main(char *a[], int n) 
-void multikeyqsort(char *a[], int n)
-{ ssort2(a, n, 0); }
+/* Sort the n suffixes with offsets in a (w bytes each) into sequence seq */
+void multikeyqsort(uchar *a, int w, const char *seq, int n)
+{ ssort2(a, w, seq, n, 0); }
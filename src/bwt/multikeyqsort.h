@@ -1,5 +1,35 @@
 /* This file is part of Kaiju, Copyright 2015,2016 Peter Menzel and Anders Krogh,
  * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+#ifndef MULTIKEYQSORT_h
+#define MULTIKEYQSORT_h
 
-void multikeyqsort(char **a, int n);
+#include <stdint.h>
+#include <string.h>
 
+#include "common.h"
+
+/*
+  Suffixes are stored as offsets into the concatenated sequence instead of
+  pointers. An offset takes w=4 bytes if the sequence is shorter than 4G letters
+  and w=5 bytes otherwise (see suffix_offset_width), compared to 8 bytes for a pointer.
+*/
+static inline int suffix_offset_width(long slen) {
+  return (slen < ((long)1<<32)) ? 4 : 5;
+}
+
+static inline long suffix_offset_get(const uchar *a, long i, int w) {
+  uint32_t lo;
+  memcpy(&lo, a+i*w, 4);
+  if (w==4) return (long)lo;
+  return (long)lo | ((long)a[i*w+4]<<32);
+}
+
+static inline void suffix_offset_set(uchar *a, long i, int w, long v) {
+  uint32_t lo = (uint32_t)v;
+  memcpy(a+i*w, &lo, 4);
+  if (w>4) a[i*w+4] = (uchar)(v>>32);
+}
+
+void multikeyqsort(uchar *a, int w, const char *seq, int n);
+
+#endif
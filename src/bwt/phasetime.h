@@ -0,0 +1,37 @@
+/* This file is part of Kaiju, Copyright 2015,2016 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+#ifndef PHASETIME_h
+#define PHASETIME_h
+
+/*
+  Timing of the phases of index construction in mkbwt and mkfmi.
+
+  Results are printed to stderr as lines
+     TIME <phase> <seconds>
+     PEAKRSS <kilobytes>
+  which are collected by util/kaiju-benchmark-index
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* Wall clock time in seconds */
+static inline double wall_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1.e-9*(double)ts.tv_nsec;
+}
+
+static inline void print_phase_time(char *phase, double seconds) {
+  fprintf(stderr,"TIME %s %.3f\n",phase,seconds);
+}
+
+/* Maximum resident set size of the process so far */
+static inline void print_peak_rss() {
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru)==0) fprintf(stderr,"PEAKRSS %ld\n",ru.ru_maxrss);
+}
+
+#endif
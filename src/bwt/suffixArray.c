@@ -15,10 +15,12 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/mman.h>
 
 #include "sequence.h"
 // #include "bwt.h"
 #include "suffixArray.h"
+#include "multikeyqsort.h"
 
 
 
@@ -54,6 +56,18 @@ static inline void suffixArray_encode_number(int nseq, long pos, uchar *code, su
 
 
 
+/* Encode the lowest n bits of k at bit b in little-endian bit stream c.
+   Bits already set in c are kept, so c must be zero-initialized.
+*/
+static inline void long2bits(long k, uchar *c, long b, int n) {
+  uint64_t val = (uint64_t)k << (b&7);
+  c += b>>3;
+  n += b&7;
+  while ( n>0 ) { *c++ |= (uchar)val; val = val>>8; n -= 8; }
+}
+
+
+
 /* Returns the bits needed to encode a number (without using log2) */
 static int bitsNeeded(long k) { int i=0; while (k>>i) ++i; return i; }
 
@@ -161,6 +175,7 @@ suffixArray *init_suffixArray(SEQstruct *ss, int chpt_exp) {
   s->sbits = bitsNeeded(s->nseq);
   s->pbits = bitsNeeded(s->maxlength);
   s->nbytes = (7+s->sbits+s->pbits)/8;
+  s->nbits = s->sbits+s->pbits;
   suffixArray_set_masks(s);
 
   // s->sa = (uchar*)malloc(s->ncheck*s->nbytes*sizeof(uchar));
@@ -192,10 +207,11 @@ static void writeseq(char *s, int l, char *term, FILE *fp) {
 
 /* Go through a suffix array and look up SA checkpoints, and write in files
  */
-void write_suffixArray_checkpoints(char **sa, IndexType start, IndexType length,
+void write_suffixArray_checkpoints(uchar *sa, int width, IndexType start, IndexType length,
 				   suffixArray *s, FILE *sa_file) {
   IndexType i, k;
   uchar code[32];
+  char *suffix;
   SEQstruct *seq;
 
   //  fprintf(stderr,"chkpt start=%ld end=%ld\n",start,start+length);
@@ -210,8 +226,9 @@ void write_suffixArray_checkpoints(char **sa, IndexType start, IndexType length,
   for (i=0; i<length; ++i, ++k) {
     if ( !(k&s->check) ) {
       // Use position in long concatenated sequence
-      seq=hash_lookupSeq(sa[i], s);
-      suffixArray_encode_number(seq->sort_order,(long)(sa[i]-seq->start), code, s);
+      suffix = s->seqstart + suffix_offset_get(sa, i, width);
+      seq=hash_lookupSeq(suffix, s);
+      suffixArray_encode_number(seq->sort_order,(long)(suffix-seq->start), code, s);
       fwrite(code,1,s->nbytes,sa_file);
       --(s->ncheck);
 
@@ -289,6 +306,7 @@ suffixArray *read_suffixArray_header(FILE *fp) {
   fread(&(s->nbytes),sizeof(int),1,fp);
   fread(&(s->sbits),sizeof(int),1,fp);
   fread(&(s->pbits),sizeof(int),1,fp);
+  s->nbits = s->sbits+s->pbits;
   fread(&(s->mask),sizeof(long),1,fp);
   fread(&(s->check),sizeof(long),1,fp);
 
@@ -314,16 +332,73 @@ suffixArray *read_suffixArray_header(FILE *fp) {
 
 
 
+/* Size of SA checkpoint array in bytes.
+   A bit-packed array is padded, so the last entry can be read as a whole word.
+*/
+size_t suffixArray_body_size(suffixArray *s) {
+  if (s->nbytes) return s->ncheck*s->nbytes*sizeof(uchar);
+  return ((s->ncheck*s->nbits+7)>>3) + sizeof(uint64_t);
+}
+
+
+
+/* Convert SA checkpoints from nbytes bytes per entry to bit-packed entries
+   of nbits bits. Nothing is done if entries are too long for fast decoding.
+*/
+void suffixArray_pack(suffixArray *s) {
+  IndexType k;
+  long b;
+  int nbytes = s->nbytes;
+  uchar *packed;
+
+  if (!s->sa || nbytes==0 || s->nbits>SA_MAXPACKBITS) return;
+
+  s->nbytes = 0;
+  packed = (uchar *)calloc(suffixArray_body_size(s),sizeof(uchar));
+  for (k=0, b=0; k<s->ncheck; ++k, b+=s->nbits)
+    long2bits(uchar2long(s->sa + k*nbytes, nbytes), packed, b, s->nbits);
+
+  free(s->sa);
+  s->sa = packed;
+}
+
+
+
+
 /* Read SA  */
 void read_suffixArray_body(suffixArray *s, FILE *fp) {
-  s->sa = (uchar *)malloc(s->ncheck*s->nbytes*sizeof(uchar));
-  fread(s->sa,sizeof(uchar),s->ncheck*s->nbytes,fp);
+  s->sa = (uchar *)malloc(suffixArray_body_size(s));
+  fread(s->sa,sizeof(uchar),suffixArray_body_size(s),fp);
+}
+
+
+
+/* Map SA body, which starts at offset in the file, instead of reading it.
+   The SA checkpoints are only touched when locating final hits, so pages are
+   fetched on demand (random access, no read-ahead) and can be evicted by the
+   kernel under memory pressure.
+*/
+void map_suffixArray_body(suffixArray *s, FILE *fp, long offset) {
+  long pagesize, delta;
+  size_t length;
+  uchar *map;
+
+  s->sa = NULL;
+  length = suffixArray_body_size(s);
+  if (length==0) return;
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  delta = offset % pagesize;
+  map = (uchar *)mmap(NULL, length+delta, PROT_READ, MAP_SHARED, fileno(fp), offset-delta);
+  if (map==MAP_FAILED) ERROR("map_suffixArray_body: could not memory-map suffix array",1);
+  madvise(map, length+delta, MADV_RANDOM);
+  s->sa = map+delta;
 }
 
 
 
 void write_suffixArray(suffixArray *s, FILE *fp) {
   write_suffixArray_header(s,fp);
-  fwrite(s->sa,sizeof(uchar),s->ncheck*s->nbytes,fp);
+  fwrite(s->sa,sizeof(uchar),suffixArray_body_size(s),fp);
 }
 
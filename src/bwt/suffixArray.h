@@ -3,6 +3,9 @@
 #ifndef SUFFIXARRAY_h
 #define SUFFIXARRAY_h
 
+#include <string.h>
+#include <stdint.h>
+
 #include "common.h"
 #include "fmi.h"
 #include "sequence.h"
@@ -14,7 +17,8 @@ typedef struct {
   IndexType ncheck;   // Number of checkpoints
   uchar *sa;          // Actual array holding SA checkpoints
   int chpt_exp;       // Exponent of checkpoint distance
-  int nbytes;         // Number of bytes used per entry
+  int nbytes;         // Number of bytes used per entry (0 if entries are bit-packed)
+  int nbits;          // Number of bits used per bit-packed entry (sbits+pbits)
   int sbits;          // Number of bits used for encoding sequence number
   int pbits;          // Number of bits used to encode position
   long mask;          // Mask for lowest pbits bits
@@ -33,6 +37,11 @@ typedef struct {
 } suffixArray;
 
 
+/* Max. bits per entry for bit-packing, such that an entry plus the bit offset
+   within its first byte can be read with a single 64 bit load */
+#define SA_MAXPACKBITS 57
+
+
 /* Decode long from n bytes */
 static inline long uchar2long(uchar *c, int n) {
   long val=*c++;
@@ -40,12 +49,28 @@ static inline long uchar2long(uchar *c, int n) {
   return val;
 }
 
+
+/* Decode n bits starting at bit b in little-endian bit stream c.
+   Reads 8 bytes, so the array has to be padded at the end.
+*/
+static inline long bits2long(uchar *c, long b, int n) {
+  uint64_t w;
+  memcpy(&w, c+(b>>3), sizeof(uint64_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64(w);
+#endif
+  return (long)( (w>>(b&7)) & (((uint64_t)1<<n)-1) );
+}
+
 /*
   For SA entry k, return seq no. (in *nseq) and position within (*pos)
-  Entry consists of nbytes bytes starting at position sa+k*nbytes.
+  Entry consists of nbytes bytes starting at position sa+k*nbytes, or, if the
+  SA is bit-packed, nbits bits starting at bit k*nbits.
 */
 static inline void suffixArray_decode_number(int *nseq, long *pos, long k, suffixArray *s) {
-  long val = uchar2long( (s->sa + k * s->nbytes), s->nbytes);
+  long val;
+  if (s->nbytes) val = uchar2long( (s->sa + k * s->nbytes), s->nbytes);
+  else val = bits2long(s->sa, k * s->nbits, s->nbits);
   *nseq = (int)(val>>s->pbits);
   *pos = val & s->mask;
 }
@@ -57,11 +82,14 @@ static inline void suffixArray_decode_number(int *nseq, long *pos, long k, suffi
 /* FUNCTION PROTOTYPES BEGIN  ( by funcprototypes.pl ) */
 void suffixArray_make_hash(SEQstruct *base, suffixArray *s, int Hstep);
 suffixArray *init_suffixArray(SEQstruct *ss, int chpt_exp);
-void write_suffixArray_checkpoints(char **sa, IndexType start, IndexType length,
+void write_suffixArray_checkpoints(uchar *sa, int width, IndexType start, IndexType length,
 				   suffixArray *s, FILE *sa_file);
 void write_suffixArray_header(suffixArray *s, FILE *fp);
 suffixArray *read_suffixArray_header(FILE *fp);
+size_t suffixArray_body_size(suffixArray *s);
+void suffixArray_pack(suffixArray *s);
 void read_suffixArray_body(suffixArray *s, FILE *fp);
+void map_suffixArray_body(suffixArray *s, FILE *fp, long offset);
 void write_suffixArray(suffixArray *s, FILE *fp);
 /* FUNCTION PROTOTYPES END */
 
@@ -18,6 +18,7 @@
 #include <deque>
 
 #include "util.hpp"
+#include "InputFile.hpp"
 
 void usage(char *progname);
 
@@ -112,8 +113,7 @@ int main(int argc, char** argv) {
 	parseNamesDmp(node2name,names_file);
 	names_file.close();
 
-	std::ifstream in_file;
-	in_file.open(in_filename);
+	InputFile in_file(in_filename);
 	if(!in_file.is_open()) {  std::cerr << "Could not open file " << in_filename << std::endl; exit(EXIT_FAILURE); }
 
 	std::ostream * out_stream;
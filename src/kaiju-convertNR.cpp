@@ -21,6 +21,35 @@
 
 void usage(char *progname);
 
+/* minimum length of the sequence pieces remaining after SEG masking, shorter pieces cannot yield a match in Kaiju's default settings */
+const size_t seg_min_length = 11;
+
+/* Removes low-complexity regions found by SEG from the sequence and writes each of the remaining pieces
+ * as a separate record with the same name, so that the masked regions do not end up in the index. */
+void write_seg_masked(std::ostream & output, const std::string & name, const std::string & seq, SegParameters * seg_params, bool & first, uint64_t & count_masked) {
+	std::string convertedseq = seq;
+	for(size_t i = 0; i < convertedseq.length(); i++) {
+		convertedseq[i] = AMINOACID_TO_NCBISTDAA[(int)convertedseq[i]];
+	}
+	std::vector<std::pair<size_t,size_t>> pieces;
+	BlastSeqLoc *seg_locs = NULL;
+	SeqBufferSeg((Uint1*)(convertedseq.data()), (Int4)convertedseq.length(), 0, seg_params, &seg_locs);
+	size_t start = 0; //start of non-SEGged piece
+	for(BlastSeqLoc * curr_loc = seg_locs; curr_loc != NULL; curr_loc = curr_loc->next) {
+		pieces.emplace_back(start, curr_loc->ssr->left - start);
+		count_masked += curr_loc->ssr->right - curr_loc->ssr->left + 1;
+		start = curr_loc->ssr->right + 1;
+	}
+	pieces.emplace_back(start, seq.length() - start);
+	BlastSeqLocFree(seg_locs);
+
+	for(auto piece : pieces) {
+		if(piece.second < seg_min_length) continue;
+		if(!first) { output << "\n";  } else { first = false; }
+		output << ">" << name << "\n" << seq.substr(piece.first, piece.second);
+	}
+}
+
 int main(int argc, char **argv) {
 
 	Config * config = new Config();
@@ -45,11 +74,12 @@ int main(int argc, char **argv) {
 	bool verbose = false;
 	bool debug = false;
 	bool addAcc = false;
+	bool seg = false;
 
 	// --------------------- START ------------------------------------------------------------------
 	// Read command line params
 	int c;
-	while ((c = getopt(argc, argv, "ahdvrm:l:g:t:i:o:e:")) != -1) {
+	while ((c = getopt(argc, argv, "ahdvrsm:l:g:t:i:o:e:")) != -1) {
 		switch (c)  {
 			case 'h':
 				usage(argv[0]);
@@ -59,6 +89,8 @@ int main(int argc, char **argv) {
 				verbose = true; break;
 			case 'a':
 				addAcc = true; break;
+			case 's':
+				seg = true; break;
 			case 'e':
 				excluded_accession_filename = optarg; break;
 			case 'l':
@@ -216,16 +248,30 @@ int main(int argc, char **argv) {
 	out_file.open(out_filename);
 	if(!out_file.is_open()) {  error("Could not open file " + out_filename + " for writing."); exit(EXIT_FAILURE); }
 
+	SegParameters * seg_params = NULL;
+	if(seg) {
+		seg_params = SegParametersNewAa();
+		seg_params->overlaps = TRUE;
+	}
+
 	std::cerr << getCurrentTime() << " Processing NR file " << nr_filename << std::endl;
 
 	bool skip = true;
 	bool first = true;
 	std::ostringstream output;
 	uint64_t outlinecount = 0;
+	uint64_t count_masked = 0;
+	std::string record_name; // name and sequence of current record when using SEG
+	std::string record_seq;
 	std::set<uint64_t> ids;
 	while(getline(inputfile.is_open() ? inputfile : std::cin, line)){
 		if(line.length() == 0) { continue; }
 		if(line[0]=='>') {
+			if(seg && !record_name.empty()) {
+				write_seg_masked(output, record_name, record_seq, seg_params, first, count_masked);
+				record_name.clear();
+				record_seq.clear();
+			}
 			std::string first_acc;
 			ids.clear();
 			if(debug) std::cerr << "processing line " << line << std::endl;
@@ -275,7 +321,12 @@ int main(int argc, char **argv) {
 					}
 					id = nodes->at(id);
 				}
-				if(keep) {
+				if(keep && seg) {
+					record_name = (addAcc ? first_acc + "_" : "") + std::to_string(lca);
+					skip = false;
+					outlinecount++;
+				}
+				else if(keep) {
 					if(!first) { output << "\n";  } else { first = false; }
 					output << ">";
 					if(addAcc) output << first_acc << "_";
@@ -291,7 +342,7 @@ int main(int argc, char **argv) {
 			if(!skip) {
 				size_t p = 0;
 				while((p = line.find_first_of("ARNDCQEGHILKMFPSTWYV",p)) != std::string::npos) {
-					output << line[p];
+					if(seg) record_seq += line[p]; else output << line[p];
 					p++;
 				}
 				outlinecount++;
@@ -302,12 +353,20 @@ int main(int argc, char **argv) {
 			output.str("");
 		}
 	}
+	if(seg && !record_name.empty()) {
+		write_seg_masked(output, record_name, record_seq, seg_params, first, count_masked);
+	}
 	output << std::endl;
 	out_file << output.str();
 	if(inputfile.is_open())
 		inputfile.close();
 	out_file.close();
 
+	if(seg) {
+		std::cerr << getCurrentTime() << " Masked " << count_masked << " residues in low-complexity regions." << std::endl;
+		SegParametersFree(seg_params);
+	}
+
 	std::cerr << getCurrentTime() << " Finished." << std::endl;
 	return EXIT_SUCCESS;
 }
@@ -324,6 +383,7 @@ void usage(char *progname) {
 	fprintf(stderr, "   -i FILENAME   Name of NR file. If this option is not used, then the program will read from STDIN.\n");
 	fprintf(stderr, "   -l FILENAME   Name of file with taxon IDs. Only records having one of these IDs as ancestor in the taxonomy will be used.\n");
 	fprintf(stderr, "   -e FILENAME   Name of file with accession numbers that will be excluded.\n");
+	fprintf(stderr, "   -s            Remove low-complexity regions from the sequences using SEG, remaining pieces shorter than %zu are dropped.\n", seg_min_length);
 	exit(EXIT_FAILURE);
 }
 
@@ -0,0 +1,241 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+
+#include <stdint.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+
+#include "util.hpp"
+#include "InputFile.hpp"
+#include "ResultStore.hpp"
+
+void usage(char *progname);
+
+struct StoreLine {
+	std::string name;
+	std::string line;
+	bool operator<(const StoreLine & other) const { return name < other.name; }
+};
+
+/* Sorts the lines in memory and writes them to a temporary file */
+void write_run(std::vector<StoreLine> & lines, const std::string & filename) {
+	std::stable_sort(lines.begin(), lines.end());
+	std::ofstream run_file(filename);
+	if(!run_file.is_open()) { error("Could not open temporary file " + filename + " for writing."); exit(EXIT_FAILURE); }
+	for(auto const & l : lines) run_file << l.line << "\n";
+	run_file.close();
+	if(run_file.fail()) { error("Could not write to temporary file " + filename); exit(EXIT_FAILURE); }
+	lines.clear();
+}
+
+/* Reads Kaiju's output file, sorts the lines by read name, and writes them into the result store.
+ * Input that does not fit into the memory limit is sorted in runs that are written to temporary files and merged. */
+void build_store(const std::string & in_filename, const std::string & store_filename, size_t memory_limit, bool verbose) {
+	InputFile in_file(in_filename);
+	if(!in_file.is_open()) { error("Could not open file " + in_filename); exit(EXIT_FAILURE); }
+
+	std::vector<StoreLine> lines;
+	std::vector<std::string> run_filenames;
+	size_t memory = 0;
+	uint64_t count_skipped = 0;
+	std::string line;
+	while(getline(in_file, line)) {
+		std::string name = result_line_name(line);
+		if(name.empty()) { count_skipped++; continue; }
+		memory += line.length() + name.length() + 2 * sizeof(std::string);
+		lines.push_back({std::move(name), line});
+		if(memory >= memory_limit) {
+			run_filenames.emplace_back(store_filename + ".tmp" + std::to_string(run_filenames.size()));
+			if(verbose) std::cerr << getCurrentTime() << " Writing sorted run to temporary file " << run_filenames.back() << std::endl;
+			write_run(lines, run_filenames.back());
+			memory = 0;
+		}
+	}
+	in_file.close();
+	if(count_skipped > 0) std::cerr << "Warning: Skipped " << count_skipped << " lines without read name in input file " << in_filename << std::endl;
+
+	ResultStoreWriter writer;
+	if(!writer.open(store_filename)) { error("Could not open file " + store_filename + " for writing."); exit(EXIT_FAILURE); }
+
+	if(run_filenames.empty()) {
+		std::stable_sort(lines.begin(), lines.end());
+		for(auto const & l : lines) writer.add(l.name, l.line);
+	}
+	else {
+		if(!lines.empty()) {
+			run_filenames.emplace_back(store_filename + ".tmp" + std::to_string(run_filenames.size()));
+			write_run(lines, run_filenames.back());
+		}
+		if(verbose) std::cerr << getCurrentTime() << " Merging " << run_filenames.size() << " sorted runs" << std::endl;
+		std::vector<std::ifstream *> runs;
+		// the run number breaks ties between equal read names, so that the order of lines in the input is kept
+		typedef std::pair<StoreLine, size_t> Head;
+		auto cmp = [](const Head & a, const Head & b) { return b.first.name < a.first.name || (b.first.name == a.first.name && b.second < a.second); };
+		std::priority_queue<Head, std::vector<Head>, decltype(cmp)> heads(cmp);
+		for(size_t i = 0; i < run_filenames.size(); i++) {
+			runs.push_back(new std::ifstream(run_filenames[i]));
+			if(!runs.back()->is_open()) { error("Could not open temporary file " + run_filenames[i]); exit(EXIT_FAILURE); }
+			if(getline(*runs.back(), line)) heads.push({{result_line_name(line), line}, i});
+		}
+		while(!heads.empty()) {
+			Head h = heads.top();
+			heads.pop();
+			writer.add(h.first.name, h.first.line);
+			if(getline(*runs[h.second], line)) heads.push({{result_line_name(line), line}, h.second});
+		}
+		for(size_t i = 0; i < runs.size(); i++) {
+			runs[i]->close();
+			delete runs[i];
+			remove(run_filenames[i].c_str());
+		}
+	}
+	writer.close();
+	if(verbose) std::cerr << getCurrentTime() << " Wrote " << writer.num_lines << " lines to result store " << store_filename << std::endl;
+}
+
+int main(int argc, char** argv) {
+
+	std::string in_filename;
+	std::string store_filename;
+	std::string out_filename;
+	std::string names_filename;
+	std::vector<std::string> names;
+	std::string range_first;
+	std::string range_last;
+	bool range = false;
+	size_t memory_limit = 1000;
+	bool verbose = false;
+
+	// --------------------- START ------------------------------------------------------------------
+	// Read command line params
+	int c;
+	while ((c = getopt(argc, argv, "hvi:s:o:n:l:f:e:m:")) != -1) {
+		switch (c)  {
+			case 'h':
+				usage(argv[0]);
+			case 'v':
+				verbose = true; break;
+			case 'i':
+				in_filename = optarg; break;
+			case 's':
+				store_filename = optarg; break;
+			case 'o':
+				out_filename = optarg; break;
+			case 'n':
+				names.emplace_back(optarg); break;
+			case 'l':
+				names_filename = optarg; break;
+			case 'f':
+				range = true;
+				range_first = optarg; break;
+			case 'e':
+				range = true;
+				range_last = optarg; break;
+			case 'm': {
+				try {
+					memory_limit = std::stoul(optarg);
+				}
+				catch(const std::invalid_argument& ia) {
+					error("Invalid numerical argument in -m " + std::string(optarg));
+					usage(argv[0]);
+				}
+				catch (const std::out_of_range& oor) {
+					error("Invalid numerical argument in -m " + std::string(optarg));
+					usage(argv[0]);
+				}
+				if(memory_limit < 1) { error("Memory limit given by -m must be at least 1."); usage(argv[0]); }
+				break;
+			}
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(store_filename.length() == 0) { error("Please specify the name of the result store file, using the -s option."); usage(argv[0]); }
+	if(in_filename.length() > 0 && (names.size() > 0 || names_filename.length() > 0 || range)) { error("Please use either option -i for building the result store or options -n, -l, -f, -e for looking up reads."); usage(argv[0]); }
+
+	if(in_filename.length() > 0) {
+		build_store(in_filename, store_filename, memory_limit << 20, verbose);
+		return EXIT_SUCCESS;
+	}
+
+	if(names_filename.length() > 0) {
+		InputFile names_file(names_filename);
+		if(!names_file.is_open()) { error("Could not open file " + names_filename); exit(EXIT_FAILURE); }
+		std::string line;
+		while(getline(names_file, line)) {
+			if(line.length() > 0) names.emplace_back(line);
+		}
+	}
+	if(names.empty() && !range) { error("Please specify the read names to look up, using the options -n, -l, -f, or -e."); usage(argv[0]); }
+
+	ResultStore store;
+	if(!store.open(store_filename)) { error("Could not open result store " + store_filename); exit(EXIT_FAILURE); }
+	if(verbose) std::cerr << "Result store " << store_filename << " contains " << store.num_lines() << " lines in " << store.num_blocks() << " blocks" << std::endl;
+
+	std::ostream * out_stream;
+	if(out_filename.length() > 0) {
+		std::ofstream * filestream = new std::ofstream();
+		filestream->open(out_filename);
+		if(!filestream->is_open()) { error("Could not open file " + out_filename + " for writing"); exit(EXIT_FAILURE); }
+		out_stream = filestream;
+	}
+	else {
+		out_stream = &std::cout;
+	}
+
+	std::vector<std::string> lines;
+	uint64_t count_missing = 0;
+	// lookups in sorted order of names reuse the decompressed block
+	std::sort(names.begin(), names.end());
+	for(auto const & name : names) {
+		if(store.lookup(name, lines) == 0) {
+			count_missing++;
+			if(verbose) std::cerr << "Read " << name << " was not found in result store." << std::endl;
+		}
+	}
+	if(range) {
+		store.scan(range_first, range_last, lines);
+	}
+	for(auto const & l : lines) (*out_stream) << l << "\n";
+	out_stream->flush();
+
+	if(out_filename.length() > 0) {
+		((std::ofstream*)out_stream)->close();
+		delete out_stream;
+	}
+	return count_missing > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void usage(char *progname) {
+	print_usage_header();
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "   %s -i kaiju.out -s kaiju.store [-m INT] [-v]\n", progname);
+	fprintf(stderr, "   %s -s kaiju.store [-n NAME] [-l FILENAME] [-f NAME] [-e NAME] [-o FILENAME] [-v]\n", progname);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Mandatory arguments:\n");
+	fprintf(stderr, "   -s FILENAME   Name of result store file.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Building the result store:\n");
+	fprintf(stderr, "   -i FILENAME   Name of Kaiju output file, which can be gzip- or zstd-compressed.\n");
+	fprintf(stderr, "   -m INT        Memory in MB used for sorting, larger inputs are sorted in temporary files next to the result store (default: 1000).\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Looking up reads:\n");
+	fprintf(stderr, "   -n NAME       Name of read to look up, can be given multiple times.\n");
+	fprintf(stderr, "   -l FILENAME   Name of file with read names to look up, one per line.\n");
+	fprintf(stderr, "   -f NAME       Output all reads with name equal to or after NAME (in byte-wise order).\n");
+	fprintf(stderr, "   -e NAME       Output all reads with name equal to or before NAME (in byte-wise order).\n");
+	fprintf(stderr, "   -o FILENAME   Name of output file (default: standard output).\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "   -v            Enable verbose output.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "The output lines are sorted by read name. The exit status is 1 if any of the reads given by -n or -l is not found.\n");
+	exit(EXIT_FAILURE);
+}
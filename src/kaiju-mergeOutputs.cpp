@@ -10,14 +10,18 @@
 #include <fstream>
 #include <unordered_map>
 #include <set>
+#include <vector>
+#include <algorithm>
 #include <locale>
 #include <string>
 #include <stdexcept>
 #include <cstdarg>
 
 #include "util.hpp"
+#include "InputFile.hpp"
 
 void usage(const char * progname);
+bool parse_line(const std::string &, bool, unsigned int, const std::string &, char &, std::string &, std::string &, std::string &);
 std::string calc_lca(std::unordered_map<uint64_t,uint64_t> &, const std::string &, const std::string &);
 
 int main(int argc, char** argv) {
@@ -25,6 +29,7 @@ int main(int argc, char** argv) {
 	std::unordered_map<uint64_t,uint64_t> nodes;
 
 	std::string nodes_filename = "";
+	std::vector<std::string> in_filenames;
 	std::string in1_filename = "";
 	std::string in2_filename = "";
 	std::string out_filename;
@@ -63,10 +68,25 @@ int main(int argc, char** argv) {
 								usage(argv[0]);
 		}
 	}
-	if(!(conflict=="1" || conflict=="2" || conflict=="lca" || conflict=="lowest")) { error("Value of argument -c must be either 1, 2, lca, or lowest."); usage(argv[0]); }
-	if(conflict=="lca" && nodes_filename.length() == 0) { error("Error: LCA mode requires the name of the nodes.dmp file, using the -t option."); usage(argv[0]); }
 	if(in1_filename.length() == 0) { error("Specify the name of the first input file, using the -i option."); usage(argv[0]); }
 	if(in2_filename.length() == 0) { error("Specify the name of the second input file, using the -j option."); usage(argv[0]); }
+	in_filenames.emplace_back(in1_filename);
+	in_filenames.emplace_back(in2_filename);
+	// further input files are given as remaining arguments
+	for(int i = optind; i < argc; i++) {
+		in_filenames.emplace_back(argv[i]);
+	}
+	const size_t num_inputs = in_filenames.size();
+
+	size_t conflict_file = 0; // index of file that has precedence, when conflict is a number
+	if(!(conflict=="lca" || conflict=="lowest")) {
+		if(conflict.find_first_not_of("0123456789") == std::string::npos) {
+			try { conflict_file = std::stoul(conflict); } catch (const std::exception&) { conflict_file = 0; }
+		}
+		if(conflict_file < 1 || conflict_file > num_inputs) { error("Value of argument -c must be either lca, lowest, or the number of an input file (1-" + std::to_string(num_inputs) + ")."); usage(argv[0]); }
+		conflict_file--;
+	}
+	if((conflict=="lca" || conflict=="lowest") && nodes_filename.length() == 0) { error("Error: Modes lca and lowest require the name of the nodes.dmp file, using the -t option."); usage(argv[0]); }
 
 	if(nodes_filename.length() > 0) {
 		std::ifstream nodes_file;
@@ -87,205 +107,121 @@ int main(int argc, char** argv) {
 		out_stream = &std::cout;
 	}
 
-	std::ifstream in1_file, in2_file;
-	in1_file.open(in1_filename);
-	if(!in1_file.is_open()) {  std::cerr << "Could not open file " << in1_filename << std::endl; exit(EXIT_FAILURE); }
-	in2_file.open(in2_filename);
-	if(!in2_file.is_open()) {  std::cerr << "Could not open file " << in2_filename << std::endl; exit(EXIT_FAILURE); }
-
+	std::vector<InputFile *> in_files;
+	for(auto const & filename : in_filenames) {
+		InputFile * in_file = new InputFile(filename);
+		if(!in_file->is_open()) {  std::cerr << "Could not open file " << filename << std::endl; exit(EXIT_FAILURE); }
+		in_files.push_back(in_file);
+	}
 
 	std::string line;
 	line.reserve(500);
 
+	// values of the current line in each input file
+	std::vector<char> classified(num_inputs);
+	std::vector<std::string> names(num_inputs);
+	std::vector<std::string> taxon_ids(num_inputs);
+	std::vector<std::string> scores(num_inputs);
+	std::vector<double> scores_d(num_inputs);
+	std::vector<size_t> candidates;
+	candidates.reserve(num_inputs);
+
 	unsigned int count = 0;
 
-	unsigned int countC1 = 0;
-	unsigned int countC2 = 0;
-	unsigned int countC12 = 0;
+	std::vector<unsigned int> countC(num_inputs,0);
+	std::vector<unsigned int> countConly(num_inputs,0);
+	unsigned int countCall = 0;
 	unsigned int countC3 = 0;
-	unsigned int countC1notC2 = 0;
-	unsigned int countC2notC1 = 0;
 
 
-	while(getline(in1_file,line)) {
+	while(getline(*in_files[0],line)) {
 		count++;
 
-		//if(debug) std::cerr << "Count=" << count << std::endl;
-		//if(debug) std::cerr << line << std::endl;
-		// get the three values
-		char classified1 = line[0];
-		if(!(classified1=='C' || classified1 =='U')) { std::cerr << "Error: Line " << count << " in file "<< in1_filename << " does not start with C or U. "<< std::endl; break; }
-		size_t index_tab1 = line.find('\t');
-		if(index_tab1 == std::string::npos) { std::cerr << "Error: Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
-		size_t index_tab2 = line.find('\t', index_tab1 + 1);
-		if(index_tab2 == std::string::npos) { std::cerr << "Error: Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
-		std::string name1 = line.substr(index_tab1 + 1, index_tab2 - index_tab1 - 1);
-		std::string taxon_id1;
-		std::string score1s = "0";
-		if(use_score && classified1=='C') { // look for third tab
-			size_t index_tab3 = line.find('\t', index_tab2 + 1);
-			if(index_tab3 == std::string::npos) { std::cerr << "Error: No score column (4th col) found in line " << count << " in file " << in1_filename << std::endl; break; }
-			// taxon id is between tab2 and tab3
-			taxon_id1 = line.substr(index_tab2 + 1, index_tab3 - index_tab2 - 1);
-			// score follows after tab3
-			size_t end = line.find_first_not_of(".0123456789",index_tab3 + 1);
-			if(end == std::string::npos) {
-				if(index_tab3 < line.length()-1){
-					end = line.length()-1;
-				}
-				else { std::cerr << "Error Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
-			}
-			else {
-				end -= 1;
-			}
-			score1s = line.substr(index_tab3 + 1, end - index_tab3);
-		}
-		else { // look to the end of the taxon id (which starts after second tab), it can either be the line end or some other columns following
-			size_t end = line.find_first_not_of("0123456789",index_tab2 + 1);
-			if(end == std::string::npos) {
-				if(index_tab2 < line.length()-1){
-					end = line.length()-1;
-				}
-				else { std::cerr << "Error Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
-			}
-			else {
-				end -= 1;
-			}
-			taxon_id1 = line.substr(index_tab2 + 1, end - index_tab2);
-		}
-
-		if(debug) std::cerr << "Name1=" << name1 <<" ID1=" << taxon_id1 << (use_score ? " Score="+score1s+"\n" : "\n");
-
-		if(!getline(in2_file,line)) {
-			//that's the border case where file1 has more entries than file2
-			std::cerr << "Error: File " << in1_filename <<" has more lines then file " << in2_filename  <<std::endl;
-			break;
-		}
-		//if(debug) std::cerr << line << std::endl;
-
-		// get the three values for second file
-		char classified2 = line[0];
-		if(!(classified2=='C' || classified2 =='U')) { std::cerr << "Error: Line " << count << " in file "<< in2_filename << " does not start with C or U. "<< std::endl; break; }
-		index_tab1 = line.find('\t');
-		if(index_tab1 == std::string::npos) { std::cerr << "Error: Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
-		index_tab2 = line.find('\t', index_tab1 + 1);
-		if(index_tab2 == std::string::npos) { std::cerr << "Error: Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
-		std::string name2 = line.substr(index_tab1 + 1, index_tab2 - index_tab1 - 1);
-		std::string taxon_id2;
-		std::string score2s = "0";
-		if(use_score and classified2=='C') { // look for third tab
-			size_t index_tab3 = line.find('\t', index_tab2 + 1);
-			if(index_tab3 == std::string::npos) { std::cerr << "Error: No score column (4th col) found in line " << count << " in file " << in2_filename << std::endl; break; }
-			// taxon id is between tab2 and tab3
-			taxon_id2 = line.substr(index_tab2 + 1, index_tab3 - index_tab2 - 1);
-			// score follows after tab3
-			size_t end = line.find_first_not_of(".0123456789",index_tab3 + 1);
-			if(end == std::string::npos) {
-				if(index_tab3 < line.length()-1){
-					end = line.length()-1;
-				}
-				else { std::cerr << "Error Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
+		// read and parse the current line from all input files in lockstep
+		bool ok = true;
+		for(size_t i = 0; i < num_inputs; i++) {
+			if(i > 0 && !getline(*in_files[i],line)) {
+				//that's the border case where file1 has more entries than file i
+				std::cerr << "Error: File " << in_filenames[0] <<" has more lines then file " << in_filenames[i]  <<std::endl;
+				ok = false; break;
 			}
-			else {
-				end -= 1;
+			if(!parse_line(line, use_score, count, in_filenames[i], classified[i], names[i], taxon_ids[i], scores[i])) { ok = false; break; }
+			if(debug) std::cerr << "Name" << i+1 << "=" << names[i] <<" ID" << i+1 << "=" << taxon_ids[i] << (use_score ? " Score="+scores[i]+"\n" : "\n");
+			if(i > 0 && names[i] != names[0]) {
+				std::cerr << "Error: Read names are not identical between the input files " << in_filenames[0] << " and " << in_filenames[i] << " on line " << count << std::endl;
+				ok = false; break;
 			}
-			score2s = line.substr(index_tab3 + 1, end - index_tab3);
 		}
-		else { // look to the end of the taxon id (which starts after second tab), it can either be the line end or some other columns following
-			size_t end = line.find_first_not_of("0123456789",index_tab2 + 1);
-			if(end == std::string::npos) {
-				if(index_tab2 < line.length()-1){
-					end = line.length()-1;
-				}
-				else { std::cerr << "Error Could not parse line " << count << " in file " << in1_filename << std::endl; break; }
-			}
-			else {
-				end -= 1;
+		if(!ok) break;
+
+		// find files that classified the read and the best score among them
+		size_t num_classified = 0;
+		double best_score = 0.0;
+		for(size_t i = 0; i < num_inputs; i++) {
+			if(classified[i] != 'C') continue;
+			countC[i]++;
+			scores_d[i] = 0.0;
+			if(use_score) {
+				try { scores_d[i] = std::stod(scores[i]); } catch (const std::exception&) { std::cerr << "Error while parsing score on line " << count << "in file " << in_filenames[i] << std::endl; }
+				if(num_classified == 0 || scores_d[i] > best_score) best_score = scores_d[i];
 			}
-			taxon_id2 = line.substr(index_tab2 + 1, end - index_tab2);
+			num_classified++;
 		}
 
-		if(debug) std::cerr << "Name2=" << name2 <<" ID2=" << taxon_id2 << (use_score ? " Score="+score2s+"\n" : "\n");
-
-		if(name1 != name2) {
-			std::cerr << "Error: Read names are not identical between the two input files on line " << count << std::endl;
-			break;
+		if(num_classified == 0) {
+			(*out_stream) << "U" << "\t" << names[0] << "\t0\n";
 		}
+		else {
+			countC3++;
+			if(num_classified == num_inputs) countCall++;
 
-		if(classified1=='C' && classified2=='C')  {
-			std::string lca;
-
-			std::string output_score;
-			bool same_score = true;
-			double score1d = 0.0;
-			double score2d = 0.0;
-			// parse score strings
-			if(use_score) {
-				try { score1d = std::stod(score1s); } catch (const std::exception&) { std::cerr << "Error while parsing score on line " << count << "in file " << in1_filename << std::endl; }
-				try { score2d = std::stod(score2s); } catch (const std::exception&) { std::cerr << "Error while parsing score on line " << count << "in file " << in2_filename << std::endl; }
-				if(score1d != score2d) { same_score = false; }
+			// candidates are all classifications with the best score, or all classifications if not using scores
+			candidates.clear();
+			for(size_t i = 0; i < num_inputs; i++) {
+				if(classified[i] == 'C' && (!use_score || scores_d[i] == best_score)) candidates.push_back(i);
 			}
+			if(num_classified == 1) countConly[candidates[0]]++;
 
-			if(taxon_id1==taxon_id2) {
-				lca = taxon_id1;
-				if(use_score) { output_score = (score2d > score1d) ? score2s : score1s; }
+			std::string lca = taxon_ids[candidates[0]];
+			bool same_taxon = true;
+			for(auto const i : candidates) {
+				if(taxon_ids[i] != lca) { same_taxon = false; break; }
 			}
-			else { // different taxon ids in both files
-				if(same_score) {
-					output_score = score1s;
-					if(conflict=="1") {
-						lca = taxon_id1;
-					}
-					else if(conflict=="2") {
-						lca = taxon_id2;
-					}
-					else if(conflict=="lowest") {
-						if(is_ancestor(nodes,taxon_id1,taxon_id2)) {
-							lca = taxon_id2;
-						}
-						else if(is_ancestor(nodes,taxon_id2,taxon_id1)) {
-							lca = taxon_id1;
-						}
-						else {
-							lca = calc_lca(nodes, taxon_id1, taxon_id2);
+
+			if(!same_taxon) {
+				if(conflict=="lowest" || conflict=="lca") {
+					bool same_lineage = false;
+					if(conflict=="lowest") {
+						// find lowest taxon if all taxa are within the same lineage
+						same_lineage = true;
+						for(auto const i : candidates) {
+							if(is_ancestor(nodes,lca,taxon_ids[i])) {
+								lca = taxon_ids[i];
+							}
+							else if(!is_ancestor(nodes,taxon_ids[i],lca)) {
+								same_lineage = false;
+								break;
+							}
 						}
-						if(lca=="0") { std::cerr << "Error while calculating lowest node of " << taxon_id1 << " and " << taxon_id2 << " in line " << count << ", setting taxon id to " << taxon_id1 << std::endl; lca=taxon_id1; }
 					}
-					else {
-						assert(conflict=="lca");
-						lca = calc_lca(nodes, taxon_id1, taxon_id2);
-						if(lca=="0") { std::cerr << "Error while calculating lowest node of " << taxon_id1 << " and " << taxon_id2 << " in line " << count << ", setting taxon id to " << taxon_id1 << std::endl; lca=taxon_id1; }
-						if(debug) std::cerr << "LCA of "<< taxon_id1 << " and " << taxon_id2 << " is "  << lca << std::endl;
+					if(!same_lineage) {
+						lca = taxon_ids[candidates[0]];
+						for(auto const i : candidates) {
+							std::string lca_new = calc_lca(nodes, lca, taxon_ids[i]);
+							if(lca_new=="0") { std::cerr << "Error while calculating lowest node of " << lca << " and " << taxon_ids[i] << " in line " << count << ", keeping taxon id " << lca << std::endl; continue; }
+							lca = lca_new;
+						}
+						if(debug) std::cerr << "LCA is "  << lca << std::endl;
 					}
 				}
-				else { //different scores
-					if(score1d > score2d) {
-						lca = taxon_id1;
-						output_score = score1s;
-					}
-					else {
-						assert(score1d < score2d);
-						lca = taxon_id2;
-						output_score = score2s;
+				else {
+					// file given by -c has precedence if it is among the candidates
+					if(std::find(candidates.begin(), candidates.end(), conflict_file) != candidates.end()) {
+						lca = taxon_ids[conflict_file];
 					}
 				}
 			}
-			countC1++; countC2++; countC12++; countC3++;
-			(*out_stream) << "C" << "\t" << name1 << "\t" << lca << (use_score ? "\t"+output_score+"\n" : "\n");
-		}
-		else if(classified1=='C') {
-			assert(classified2=='U');
-			countC1++; countC1notC2++; countC3++;
-			(*out_stream) << "C" << "\t" << name1 << "\t" << taxon_id1 << (use_score ? "\t"+score1s+"\n" : "\n");
-		}
-		else if(classified2=='C') {
-			assert(classified1=='U');
-			countC2++; countC2notC1++; countC3++;
-			(*out_stream) << "C" << "\t" << name1 << "\t" << taxon_id2 << (use_score ? "\t"+score2s+"\n" : "\n");
-		}
-		else {
-			assert(classified1=='U' && classified2=='U');
-			(*out_stream) << "U" << "\t" << name1 << "\t0\n";
+			(*out_stream) << "C" << "\t" << names[0] << "\t" << lca << (use_score ? "\t"+scores[candidates[0]]+"\n" : "\n");
 		}
 
 		if(count%20000==0) {
@@ -295,12 +231,12 @@ int main(int argc, char** argv) {
 	} // end main loop around file1
 
 
-	if(in1_file.is_open()) in1_file.close();
-	if(in2_file.is_open()) {
-		if(getline(in2_file,line) && line.length()>0) {
-			std::cerr << "Warning: File " << in2_filename <<" has more lines then file " << in1_filename  <<std::endl;
+	for(size_t i = 0; i < num_inputs; i++) {
+		if(i > 0 && getline(*in_files[i],line) && line.length()>0) {
+			std::cerr << "Warning: File " << in_filenames[i] <<" has more lines then file " << in_filenames[0]  <<std::endl;
 		}
-		in2_file.close();
+		in_files[i]->close();
+		delete in_files[i];
 	}
 
 	out_stream->flush();
@@ -311,20 +247,66 @@ int main(int argc, char** argv) {
 
 	if(verbose) {
 		fprintf(stderr, "Number of all reads in input:\t%10u\n",count);
-		fprintf(stderr, "         classified in file1:\t%10u  %6.2f%%\n",countC1,((double)countC1/(double)count*100.0));
-		fprintf(stderr, "            but not in file2:\t%10u  %6.2f%%\n",countC1notC2,((double)countC1notC2/(double)count*100.0));
-		fprintf(stderr, "         classified in file2:\t%10u  %6.2f%%\n",countC2,((double)countC2/(double)count*100.0));
-		fprintf(stderr, "            but not in file1:\t%10u  %6.2f%%\n",countC2notC1,((double)countC2notC1/(double)count*100.0));
-		fprintf(stderr, "          classified in both:\t%10u  %6.2f%%\n",countC12,((double)countC12/(double)count*100.0));
+		for(size_t i = 0; i < num_inputs; i++) {
+			std::string label = "classified in file" + std::to_string(i+1) + ":";
+			fprintf(stderr, "%29s\t%10u  %6.2f%%\n",label.c_str(),countC[i],((double)countC[i]/(double)count*100.0));
+			fprintf(stderr, "%29s\t%10u  %6.2f%%\n",num_inputs > 2 ? "but not in other files:" : "but not in other file:",countConly[i],((double)countConly[i]/(double)count*100.0));
+		}
+		fprintf(stderr, "     classified in all files:\t%10u  %6.2f%%\n",countCall,((double)countCall/(double)count*100.0));
 		fprintf(stderr, "         combined classified:\t%10u  %6.2f%%\n",countC3,((double)countC3/(double)count*100.0));
 	}
 
 	return EXIT_SUCCESS;
 }
 
+/* Parses first three columns and optionally the score in the 4th column of one line.
+   Returns false if the line could not be parsed. */
+bool parse_line(const std::string & line, bool use_score, unsigned int count, const std::string & filename, char & classified, std::string & name, std::string & taxon_id, std::string & score) {
+	classified = line[0];
+	if(!(classified=='C' || classified =='U')) { std::cerr << "Error: Line " << count << " in file "<< filename << " does not start with C or U. "<< std::endl; return false; }
+	size_t index_tab1 = line.find('\t');
+	if(index_tab1 == std::string::npos) { std::cerr << "Error: Could not parse line " << count << " in file " << filename << std::endl; return false; }
+	size_t index_tab2 = line.find('\t', index_tab1 + 1);
+	if(index_tab2 == std::string::npos) { std::cerr << "Error: Could not parse line " << count << " in file " << filename << std::endl; return false; }
+	name = line.substr(index_tab1 + 1, index_tab2 - index_tab1 - 1);
+	score = "0";
+	if(use_score && classified=='C') { // look for third tab
+		size_t index_tab3 = line.find('\t', index_tab2 + 1);
+		if(index_tab3 == std::string::npos) { std::cerr << "Error: No score column (4th col) found in line " << count << " in file " << filename << std::endl; return false; }
+		// taxon id is between tab2 and tab3
+		taxon_id = line.substr(index_tab2 + 1, index_tab3 - index_tab2 - 1);
+		// score follows after tab3
+		size_t end = line.find_first_not_of(".0123456789",index_tab3 + 1);
+		if(end == std::string::npos) {
+			if(index_tab3 < line.length()-1){
+				end = line.length()-1;
+			}
+			else { std::cerr << "Error Could not parse line " << count << " in file " << filename << std::endl; return false; }
+		}
+		else {
+			end -= 1;
+		}
+		score = line.substr(index_tab3 + 1, end - index_tab3);
+	}
+	else { // look to the end of the taxon id (which starts after second tab), it can either be the line end or some other columns following
+		size_t end = line.find_first_not_of("0123456789",index_tab2 + 1);
+		if(end == std::string::npos) {
+			if(index_tab2 < line.length()-1){
+				end = line.length()-1;
+			}
+			else { std::cerr << "Error Could not parse line " << count << " in file " << filename << std::endl; return false; }
+		}
+		else {
+			end -= 1;
+		}
+		taxon_id = line.substr(index_tab2 + 1, end - index_tab2);
+	}
+	return true;
+}
+
 void usage(const char * progname) {
 	print_usage_header();
-	fprintf(stderr, "Usage:\n   %s -i in1.tsv -j in2.tsv [-o outfile.tsv] [-c 1|2|lca|lowest] [-s] [-t nodes.dmp] [-v] [-d]\n", progname);
+	fprintf(stderr, "Usage:\n   %s -i in1.tsv -j in2.tsv [-o outfile.tsv] [-c lca|lowest|1|2|...] [-s] [-t nodes.dmp] [-v] [-d] [in3.tsv ...]\n", progname);
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Mandatory arguments:\n");
 	fprintf(stderr, "   -i FILENAME   Name of first input file\n");
@@ -332,21 +314,24 @@ void usage(const char * progname) {
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Optional arguments:\n");
 	fprintf(stderr, "   -o FILENAME   Name of output file.\n");
-	fprintf(stderr, "   -c STRING     Conflict resolution mode, must be 1, 2,  lca, or lowest (default: lca)\n");
-	fprintf(stderr, "   -t FILENAME   Name of nodes.dmp file, only required when -c is set to lca\n");
+	fprintf(stderr, "   -c STRING     Conflict resolution mode, must be lca, lowest, or the number of an input file (default: lca)\n");
+	fprintf(stderr, "   -t FILENAME   Name of nodes.dmp file, only required when -c is set to lca or lowest\n");
 	fprintf(stderr, "   -s            Use 4th column with classification score to give precedence to taxon with better score.\n");
 	fprintf(stderr, "   -v            Enable verbose output, which will print a summary in the end.\n");
 	fprintf(stderr, "   -d            Enable debug output.\n");
 	fprintf(stderr, "\n");
-	fprintf(stderr, "NOTE: Both input files need to be sorted by the read name in the second column.\n");
+	fprintf(stderr, "Further input files can be given as additional arguments after the options, which are all merged in one pass.\n");
+	fprintf(stderr, "NOTE: All input files need to be sorted by the read name in the second column.\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "The option -c determines the method of resolving conflicts in the taxonomic assignment for a read.\n");
-	fprintf(stderr, "Possible values are '1', '2', 'lca', 'lowest':\n");
+	fprintf(stderr, "Possible values are '1', '2', ..., 'lca', 'lowest':\n");
 	fprintf(stderr, "  '1' -> the taxon id from the first input file is used.\n");
-	fprintf(stderr, "  '2' -> the taxon id from the second input file is used.\n");
-	fprintf(stderr, "  'lca' -> the least common ancestor of the two taxon ids from both input files is used.\n");
-	fprintf(stderr, "  'lowest' -> the lower rank of the two taxa is used if they are within the same lineage. Otherwise the LCA is used.\n");
+	fprintf(stderr, "  '2' -> the taxon id from the second input file is used, and so on for further input files.\n");
+	fprintf(stderr, "         If that file has no classification for the read, the first file in the order of the input files is used.\n");
+	fprintf(stderr, "  'lca' -> the least common ancestor of the taxon ids from all input files is used.\n");
+	fprintf(stderr, "  'lowest' -> the lowest taxon is used if all taxa are within the same lineage. Otherwise the LCA is used.\n");
 	fprintf(stderr, "When using values 'lca' or 'lowest', the path to the file nodes.dmp needs to be specified via option -t.\n");
+	fprintf(stderr, "When using option -s, only the taxa with the highest score are considered for resolving conflicts.\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -370,15 +355,15 @@ std::string calc_lca(std::unordered_map<uint64_t,uint64_t> & nodes, const std::s
 		}
 
 		if(nodes.count(node1)==0 && nodes.count(node2)==0) {
-			std::cerr << "Warning: Taxon IDs " << node1 << " and " << node2 << " from both input files are not contained in taxonomic tree.\n";
+			std::cerr << "Warning: Taxon IDs " << node1 << " and " << node2 << " are not contained in taxonomic tree.\n";
 			return "0";
 		}
 		else if(nodes.count(node1)==0) {
-			std::cerr << "Warning: Taxon ID " << node1 << " in first input file is not contained in taxonomic tree.\n";
+			std::cerr << "Warning: Taxon ID " << node1 << " is not contained in taxonomic tree.\n";
 			return std::to_string(node2);
 		}
 		else if(nodes.count(node2)==0) {
-			std::cerr << "Warning: Taxon ID " << node2 << " in second input file is not contained in taxonomic tree.\n";
+			std::cerr << "Warning: Taxon ID " << node2 << " is not contained in taxonomic tree.\n";
 			return std::to_string(node1);
 		}
 
@@ -389,10 +374,11 @@ std::string calc_lca(std::unordered_map<uint64_t,uint64_t> & nodes, const std::s
 			node1 = nodes.at(node1);
 		}
 
+		// climb up from node2 until reaching the lineage of node1, node2 itself may be in the lineage
 		uint64_t lca = node2;
-		do {
+		while(lineage1.count(lca)==0 && lca != nodes.at(lca)) {
 			lca = nodes.at(lca);
-		} while(lineage1.count(lca)==0 && lca != nodes.at(lca));
+		}
 
 
 		return std::to_string(lca);
@@ -33,6 +33,7 @@
 #include <algorithm>
 #include <string>
 #include <deque>
+#include <vector>
 #include <stdexcept>
 
 #include "ProducerConsumerQueue/src/ProducerConsumerQueue.hpp"
@@ -49,6 +50,25 @@ extern "C" {
 
 void usage(char *progname);
 
+/* index of the barcode with the fewest mismatches to the start of observed,
+ * or -1 if there is none within max_mismatches or if the best one is not unique */
+static int match_barcode(const std::string & observed, const std::vector<std::string> & barcodes, unsigned int max_mismatches) {
+	int best = -1;
+	unsigned int best_mismatches = max_mismatches + 1;
+	bool unique = false;
+	for(size_t i = 0; i < barcodes.size(); i++) {
+		const std::string & b = barcodes[i];
+		if(observed.length() < b.length()) continue;
+		unsigned int mm = 0;
+		for(size_t k = 0; k < b.length() && mm <= max_mismatches; k++) {
+			if(b[k] != observed[k] && b[k] != 'N' && observed[k] != 'N') mm++;
+		}
+		if(mm < best_mismatches) { best = (int)i; best_mismatches = mm; unique = true; }
+		else if(mm == best_mismatches) unique = false;
+	}
+	return unique ? best : -1;
+}
+
 int main(int argc, char** argv) {
 
 
@@ -62,6 +82,9 @@ int main(int argc, char** argv) {
 	std::string in1_filename;
 	std::string in2_filename;
 	std::string output_filename;
+	std::string barcodes_filename;
+	std::string index_filename;
+	unsigned int barcode_mismatches = 1;
 
 	int num_threads = 1;
 	bool verbose = false;
@@ -71,11 +94,12 @@ int main(int argc, char** argv) {
 	// --------------------- START ------------------------------------------------------------------
 	// Read command line params
 	int c;
-	while ((c = getopt(argc, argv, "a:hdpxXvn:m:e:E:l:t:f:i:j:s:z:o:")) != -1) {
+	while ((c = getopt(argc, argv, "a:hdpxXLvn:m:e:E:l:t:f:i:j:s:z:o:b:I:M:")) != -1) {
 		switch (c)  {
 			case 'a': {
 									if("mem" == std::string(optarg)) config->mode = MEM;
 									else if("greedy" == std::string(optarg)) config->mode = GREEDY;
+									else if("bnb" == std::string(optarg)) config->mode = BNB;
 									else { std::cerr << "-a must be a valid mode.\n"; usage(argv[0]); }
 									break;
 								}
@@ -91,6 +115,8 @@ int main(int argc, char** argv) {
 				config->SEG = true; break;
 			case 'X':
 				config->SEG = false; break;
+			case 'L':
+				config->mmap_index = true; break;
 			case 'o':
 				output_filename = optarg; break;
 			case 'f':
@@ -99,6 +125,24 @@ int main(int argc, char** argv) {
 				nodes_filename = optarg; break;
 			case 'i':
 				in1_filename = optarg; break;
+			case 'b':
+				barcodes_filename = optarg; break;
+			case 'I':
+				index_filename = optarg; break;
+			case 'M': {
+									try {
+										int mm = std::stoi(optarg);
+										if(mm < 0) { error("Number of barcode mismatches (-M) must be >= 0."); usage(argv[0]); }
+										barcode_mismatches = (unsigned int)mm;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -M " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -M " << optarg << std::endl;
+									}
+									break;
+								}
 			case 'j': {
 									in2_filename = optarg;
 									paired = true;
@@ -195,7 +239,9 @@ int main(int argc, char** argv) {
 	if(fmi_filename.length() == 0) { error("Please specify the location of the FMI file, using the -f option."); usage(argv[0]); }
 	if(in1_filename.length() == 0) { error("Please specify the location of the input file, using the -i option."); usage(argv[0]); }
 	if(paired && config->input_is_protein) { error("Protein input only supports one input file."); usage(argv[0]); }
-	if(config->use_Evalue && config->mode != GREEDY ) { error("E-value calculation is only available in Greedy mode. Use option: -a greedy"); usage(argv[0]); }
+	if(barcodes_filename.length() > 0 && output_filename.length() > 0) { error("Output files are given in the barcode sheet, option -o cannot be used together with -b."); usage(argv[0]); }
+	if(index_filename.length() > 0 && barcodes_filename.length() == 0) { error("Option -I requires a barcode sheet, using the -b option."); usage(argv[0]); }
+	if(config->use_Evalue && config->mode == MEM ) { error("E-value calculation is only available in Greedy and BNB modes. Use option: -a greedy"); usage(argv[0]); }
 
 	if(debug) {
 		std::cerr << "Parameters: \n";
@@ -205,11 +251,15 @@ int main(int argc, char** argv) {
 		if(config->use_Evalue)
 			std::cerr << "  minimum E-value: " << config->min_Evalue << "\n";
 		std::cerr << "  max number of mismatches within a match: "  << config->mismatches << "\n";
-		std::cerr << "  run mode: "  << ((config->mode==MEM) ? "MEM" : "Greedy") << "\n";
+		std::cerr << "  run mode: "  << ((config->mode==MEM) ? "MEM" : (config->mode==BNB) ? "Branch-and-bound" : "Greedy") << "\n";
 		std::cerr << "  input files 1: " << in1_filename << "\n";
 		if(in2_filename.length() > 0)
 			std::cerr << "  input files 2: " << in2_filename << "\n";
 		std::cerr << "  output files: " << output_filename << "\n";
+		if(barcodes_filename.length() > 0) {
+			std::cerr << "  barcode sheet: " << barcodes_filename << "\n";
+			std::cerr << "  max number of mismatches within a barcode: " << barcode_mismatches << "\n";
+		}
 	}
 
 	/* parse lists of input files and output files and sanity-check */
@@ -265,6 +315,40 @@ int main(int argc, char** argv) {
 		exit(1);
 	}
 
+	/* read barcode sheet, each line contains a barcode and the name of the output file for that sample.
+	   Several barcodes can share one output file and barcode * receives all reads without a matching barcode. */
+	std::vector<std::string> barcodes;
+	std::vector<int> barcode2sample;
+	int undetermined_sample = -1;
+	if(barcodes_filename.length() > 0) {
+		if(fname1_list.size() != 1 || fname2_list.size() > 1) { error("Demultiplexing with -b requires exactly one input file (or one pair of files)."); exit(EXIT_FAILURE); }
+		std::ifstream barcodes_file;
+		barcodes_file.open(barcodes_filename);
+		if(!barcodes_file.is_open()) { error("Could not open file " + barcodes_filename); exit(EXIT_FAILURE); }
+		std::string line;
+		while(getline(barcodes_file,line)) {
+			if(line.length() == 0 || line[0] == '#') continue;
+			size_t tab = line.find('\t');
+			if(tab == std::string::npos || tab == 0 || tab+1 >= line.length()) { error("Malformed line in barcode sheet: " + line); exit(EXIT_FAILURE); }
+			std::string barcode = line.substr(0,tab);
+			std::string out = line.substr(tab+1);
+			if(!out.empty() && out.back() == '\r') out.pop_back();
+			std::transform(barcode.begin(), barcode.end(), barcode.begin(), ::toupper);
+			int sample = (int)(std::find(fname_out_list.begin(), fname_out_list.end(), out) - fname_out_list.begin());
+			if(sample == (int)fname_out_list.size()) fname_out_list.emplace_back(out);
+			if(barcode == "*") {
+				undetermined_sample = sample;
+			}
+			else {
+				if(std::find(barcodes.begin(), barcodes.end(), barcode) != barcodes.end()) { error("Barcode " + barcode + " is contained more than once in the barcode sheet."); exit(EXIT_FAILURE); }
+				barcodes.emplace_back(barcode);
+				barcode2sample.emplace_back(sample);
+			}
+		}
+		barcodes_file.close();
+		if(barcodes.empty()) { error("No barcodes found in file " + barcodes_filename); exit(EXIT_FAILURE); }
+	}
+
 	// check if all input files are readable
 	for(auto const & f : fname1_list) {
 		std::ifstream test_file;
@@ -278,6 +362,12 @@ int main(int argc, char** argv) {
 		if(!test_file.is_open()) { error("Could not open file " + f); exit(EXIT_FAILURE); }
 		test_file.close();
 	}
+	if(index_filename.length() > 0) {
+		std::ifstream test_file;
+		test_file.open(index_filename.c_str());
+		if(!test_file.is_open()) { error("Could not open file " + index_filename); exit(EXIT_FAILURE); }
+		test_file.close();
+	}
 
 	config->nodes = nodes;
 	config->debug = debug;
@@ -297,6 +387,20 @@ int main(int argc, char** argv) {
 	config->init();
 	config->out_stream = &std::cout;
 
+	std::vector<uint64_t> sample_reads;
+	uint64_t undetermined_reads = 0;
+	std::unordered_map<std::string,int> barcode_cache; // observed barcode -> sample
+	if(barcodes_filename.length() > 0) {
+		for(auto const & f : fname_out_list) {
+			if(verbose) std::cerr << getCurrentTime() <<  " Output file: " << f << std::endl;
+			std::ofstream * sample_file = new std::ofstream();
+			sample_file->open(f);
+			if(!sample_file->is_open()) {  error("Could not open file " + f + " for writing"); exit(EXIT_FAILURE); }
+			config->sample_streams.push_back(sample_file);
+		}
+		sample_reads.assign(fname_out_list.size(), 0);
+	}
+
 	//iterate through input files
 	for(int i_files = 0; i_files < fname1_list.size(); i_files++) {
 
@@ -330,6 +434,7 @@ int main(int argc, char** argv) {
 
 		zstr::ifstream* in1_file = nullptr;
 		zstr::ifstream* in2_file = nullptr;
+		zstr::ifstream* index_file = nullptr;
 		try {
 			in1_file = new zstr::ifstream(fname_in1);
 			if(!in1_file->good()) {  error("Could not open file " + fname_in1); exit(EXIT_FAILURE); }
@@ -341,6 +446,12 @@ int main(int argc, char** argv) {
 				if(!in2_file->good()) {  error("Could not open file " + fname_in2); exit(EXIT_FAILURE); }
 			} catch(std::exception e) { error("Could not open file " + fname_in2); exit(EXIT_FAILURE); }
 		}
+		if(index_filename.length() > 0) {
+			try {
+				index_file = new zstr::ifstream(index_filename);
+				if(!index_file->good()) {  error("Could not open file " + index_filename); exit(EXIT_FAILURE); }
+			} catch(std::exception e) { error("Could not open file " + index_filename); exit(EXIT_FAILURE); }
+		}
 
 		bool firstline_file1 = true;
 		bool firstline_file2 = true;
@@ -352,6 +463,7 @@ int main(int argc, char** argv) {
 		std::string name;
 		std::string sequence1;
 		std::string sequence2;
+		std::string barcode;
 		sequence1.reserve(2000);
 		if(paired) sequence2.reserve(2000);
 
@@ -369,6 +481,13 @@ int main(int argc, char** argv) {
 				}
 				firstline_file1 = false;
 			}
+			if(barcodes_filename.length() > 0 && !index_file) {
+				// barcode is the last field of the Illumina read name comment, e.g. ' 1:N:0:TAAGGCGA' or ' 1:N:0:TAAGGCGA+CTCTCTAT'
+				size_t space = line_from_file.find(' ');
+				size_t colon = line_from_file.find_last_of(':');
+				if(space != std::string::npos && colon != std::string::npos && colon > space) barcode = line_from_file.substr(colon+1);
+				else barcode.clear();
+			}
 			if(isFastQ_file1) {
 				// remove '@' from beginning of line
 				line_from_file.erase(line_from_file.begin());
@@ -401,6 +520,42 @@ int main(int argc, char** argv) {
 
 			strip(sequence1); // remove non-alphabet chars
 
+			int sample = 0;
+			if(barcodes_filename.length() > 0) {
+				if(index_file) {
+					// index read, only FASTQ
+					line_from_file = "";
+					while(line_from_file.length() == 0) {
+						if(!getline(*index_file,line_from_file)) {
+							error("File " + fname_in1 + " contains more reads then file " + index_filename);
+							exit(EXIT_FAILURE);
+						}
+					}
+					if(line_from_file[0] != '@') { error("File " + index_filename + " must be in FASTQ format."); exit(EXIT_FAILURE); }
+					line_from_file.erase(line_from_file.begin());
+					size_t n = line_from_file.find_first_of(suffixStartCharacters);
+					if(n != std::string::npos) { line_from_file.erase(n); }
+					if(name != line_from_file) {
+						error("Read names are not identical between the input file and the index read file.");
+						exit(EXIT_FAILURE);
+					}
+					getline(*index_file,barcode);
+					index_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+					index_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+				}
+				if(!barcode.empty() && barcode.back() == '\r') barcode.pop_back();
+				auto it = barcode_cache.find(barcode);
+				if(it == barcode_cache.end()) {
+					std::string observed = barcode;
+					std::transform(observed.begin(), observed.end(), observed.begin(), ::toupper);
+					int b = match_barcode(observed, barcodes, barcode_mismatches);
+					it = barcode_cache.emplace(barcode, b < 0 ? undetermined_sample : barcode2sample[b]).first;
+				}
+				sample = it->second;
+				if(sample < 0 || sample == undetermined_sample) undetermined_reads++;
+				if(sample >= 0) sample_reads[sample]++;
+			}
+
 			if(paired) {
 				line_from_file = "";
 				while(line_from_file.length() == 0) {
@@ -456,10 +611,16 @@ int main(int argc, char** argv) {
 					}
 				}
 				strip(sequence2); // remove non-alphabet chars
-				myWorkQueue->push(new ReadItem(name, sequence1, sequence2));
+				if(sample < 0) continue; // no matching barcode
+				ReadItem * item = new ReadItem(name, sequence1, sequence2);
+				item->sample = sample;
+				myWorkQueue->push(item);
 			} // not paired
 			else {
-				myWorkQueue->push(new ReadItem(name, sequence1));
+				if(sample < 0) continue; // no matching barcode
+				ReadItem * item = new ReadItem(name, sequence1);
+				item->sample = sample;
+				myWorkQueue->push(item);
 			}
 
 		} // end main loop around file1
@@ -467,6 +628,7 @@ int main(int argc, char** argv) {
 		myWorkQueue->pushedLast();
 
 		delete in1_file;
+		if(index_file) delete index_file;
 
 		if(paired && in2_file->good()) {
 			if(getline(*in2_file,line_from_file) && line_from_file.length()>0) {
@@ -492,6 +654,14 @@ int main(int argc, char** argv) {
 
 	} // end loop around file list
 
+	for(size_t i = 0; i < config->sample_streams.size(); i++) {
+		config->sample_streams[i]->flush();
+		((std::ofstream*)config->sample_streams[i])->close();
+		delete ((std::ofstream*)config->sample_streams[i]);
+		if(verbose) std::cerr << getCurrentTime() << " " << sample_reads[i] << " reads written to " << fname_out_list[i] << std::endl;
+	}
+	if(verbose && barcodes_filename.length() > 0) std::cerr << getCurrentTime() << " " << undetermined_reads << " reads without matching barcode" << std::endl;
+
 	if(verbose) std::cerr << getCurrentTime() << " Finished." << std::endl;
 
 
@@ -512,15 +682,20 @@ void usage(char *progname) {
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Optional arguments:\n");
 	fprintf(stderr, "   -j FILENAME   List of secondary input files for paired-end reads\n");
+	fprintf(stderr, "   -b FILENAME   Barcode sheet for demultiplexing one input file (or pair) in place of -o,\n");
+	fprintf(stderr, "                 each line contains a barcode and the name of the output file for that sample\n");
+	fprintf(stderr, "   -I FILENAME   Input file containing the index reads, otherwise barcodes are taken from read names\n");
+	fprintf(stderr, "   -M INT        Number of mismatches allowed in barcodes (default: 1)\n");
 	fprintf(stderr, "   -z INT        Number of parallel threads for classification (default: 1)\n");
-	fprintf(stderr, "   -a STRING     Run mode, either \"mem\"  or \"greedy\" (default: greedy)\n");
-	fprintf(stderr, "   -e INT        Number of mismatches allowed in Greedy mode (default: 3)\n");
+	fprintf(stderr, "   -a STRING     Run mode, either \"mem\", \"greedy\", or \"bnb\" (default: greedy)\n");
+	fprintf(stderr, "   -e INT        Number of mismatches allowed in Greedy and BNB modes (default: 3)\n");
 	fprintf(stderr, "   -m INT        Minimum match length (default: 11)\n");
 	fprintf(stderr, "   -s INT        Minimum match score in Greedy mode (default: 65)\n");
 	fprintf(stderr, "   -E FLOAT      Minimum E-value in Greedy mode\n");
 	fprintf(stderr, "   -x            Enable SEG low complexity filter (enabled by default)\n");
 	fprintf(stderr, "   -X            Disable SEG low complexity filter\n");
 	fprintf(stderr, "   -p            Input sequences are protein sequences\n");
+	fprintf(stderr, "   -L            Low-memory mode: only keep BWT and FM-index in RAM, read suffix array from disk\n");
 	fprintf(stderr, "   -v            Enable verbose output\n");
 	//fprintf(stderr, "   -d            Enable debug output.\n");
 	exit(EXIT_FAILURE);
@@ -0,0 +1,451 @@
+/* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
+ * Kaiju is licensed under the GPLv3, see the file LICENSE. */
+
+#include <stdint.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <stdexcept>
+
+#include "ProducerConsumerQueue/src/ProducerConsumerQueue.hpp"
+#include "zstr/zstr.hpp"
+#include "ReadItem.hpp"
+#include "ConsumerThread.hpp"
+#include "Config.hpp"
+#include "util.hpp"
+
+extern "C" {
+#include "./bwt/bwt.h"
+}
+
+void usage(char *progname);
+
+/* one point of the parameter grid and the classification results of the sample with it */
+class TuneSetting {
+	public:
+		Mode mode = GREEDY;
+		unsigned int mismatches = 0;
+		unsigned int min_score = 0;
+		double min_Evalue = 0.0;
+		unsigned int min_fragment_length = 0;
+		bool SEG = true;
+		double seconds = 0.0;
+		uint64_t num_classified = 0;
+		double agreement = 0.0; // fraction of reads with the same taxon id as with the most sensitive setting
+		bool pareto = false;
+		std::vector<uint64_t> taxa; // taxon id of each read in the sample, 0 = unclassified
+};
+
+std::vector<std::string> split_list(const std::string & arg) {
+	std::vector<std::string> items;
+	size_t begin = 0;
+	size_t pos = -1;
+	do {
+		pos = arg.find(",",pos+1);
+		std::string item = arg.substr(begin,(pos == std::string::npos) ? std::string::npos : pos - begin);
+		begin = pos+1;
+		if(item.length() > 0) items.emplace_back(item);
+	} while(pos != std::string::npos);
+	return items;
+}
+
+/* parses a comma-separated list of integers given in option opt, which must be at least min_value */
+std::vector<unsigned int> parse_int_list(const std::string & arg, char opt, int min_value, char * progname) {
+	std::vector<unsigned int> values;
+	for(auto const & item : split_list(arg)) {
+		try {
+			int value = std::stoi(item);
+			if(value < min_value) { error("Values in -" + std::string(1,opt) + " must be >= " + std::to_string(min_value) + "."); usage(progname); }
+			values.push_back((unsigned int)value);
+		}
+		catch(const std::invalid_argument& ia) {
+			error("Invalid numerical argument in -" + std::string(1,opt) + " " + item);
+			usage(progname);
+		}
+		catch (const std::out_of_range& oor) {
+			error("Invalid numerical argument in -" + std::string(1,opt) + " " + item);
+			usage(progname);
+		}
+	}
+	if(values.empty()) { error("Option -" + std::string(1,opt) + " needs at least one value."); usage(progname); }
+	return values;
+}
+
+/* reads the first max_reads reads from a FASTA or FASTQ file, with read names truncated like in kaiju */
+void read_sample(const std::string & filename, size_t max_reads, std::vector<std::string> & names, std::vector<std::string> & sequences) {
+	zstr::ifstream * in_file = nullptr;
+	try {
+		in_file = new zstr::ifstream(filename);
+		if(!in_file->good()) {  error("Could not open file " + filename); exit(EXIT_FAILURE); }
+	} catch(std::exception e) { error("Could not open file " + filename); exit(EXIT_FAILURE); }
+
+	std::string line;
+	std::string sequence;
+	bool isFastQ = false;
+	bool firstline = true;
+	while(names.size() < max_reads && getline(*in_file,line)) {
+		if(line.length() == 0) { continue; }
+		if(firstline) {
+			if(line[0] == '@') isFastQ = true;
+			else if(line[0] != '>') { error("Auto-detection of file type for file " + filename + " failed."); exit(EXIT_FAILURE); }
+			firstline = false;
+		}
+		line.erase(line.begin());
+		size_t n = line.find_first_of(" /\t\r");
+		if(n != std::string::npos) { line.erase(n); }
+		names.emplace_back(line);
+		sequence.clear();
+		if(isFastQ) {
+			getline(*in_file,sequence);
+			// skip + line and quality score line
+			in_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			in_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		}
+		else {
+			while(!(in_file->peek()=='>' || in_file->peek()==EOF)) {
+				getline(*in_file,line);
+				sequence.append(line);
+			}
+		}
+		strip(sequence); // remove non-alphabet chars
+		sequences.emplace_back(sequence);
+	}
+	delete in_file;
+}
+
+/* classifies the sample with the parameters of setting and stores the taxon id of each read */
+void run_setting(Config * config, TuneSetting & setting, const std::vector<std::string> & sequences1, const std::vector<std::string> & sequences2, int num_threads) {
+	config->mode = setting.mode;
+	config->use_Evalue = setting.mode != MEM;
+	config->mismatches = setting.mismatches;
+	config->min_score = setting.min_score;
+	config->min_Evalue = setting.min_Evalue;
+	config->min_fragment_length = setting.min_fragment_length;
+	config->SEG = setting.SEG;
+
+	std::ostringstream output;
+	config->out_stream = &output;
+
+	// the reads are named by their number in the sample, which is used for matching the output lines
+	std::vector<ReadItem *> items;
+	items.reserve(sequences1.size());
+	for(size_t i = 0; i < sequences1.size(); i++) {
+		if(sequences2.empty()) items.push_back(new ReadItem(std::to_string(i), sequences1[i]));
+		else items.push_back(new ReadItem(std::to_string(i), sequences1[i], sequences2[i]));
+	}
+
+	std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+	ProducerConsumerQueue<ReadItem*>* queue = new ProducerConsumerQueue<ReadItem*>(500);
+	std::deque<std::thread> threads;
+	std::deque<ConsumerThread *> threadpointers;
+	for(int i = 0; i < num_threads; i++) {
+		ConsumerThread * p = new ConsumerThread(queue, config);
+		threadpointers.push_back(p);
+		threads.push_back(std::thread(&ConsumerThread::doWork,p));
+	}
+	for(auto item : items) queue->push(item);
+	queue->pushedLast();
+	while(!threads.empty()) {
+		threads.front().join();
+		threads.pop_front();
+		delete threadpointers.front();
+		threadpointers.pop_front();
+	}
+	setting.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+	delete queue;
+
+	setting.taxa.assign(sequences1.size(), 0);
+	setting.num_classified = 0;
+	std::istringstream lines(output.str());
+	std::string line;
+	while(getline(lines, line)) {
+		if(line.length() == 0 || line[0] != 'C') continue;
+		size_t start = line.find('\t') + 1;
+		size_t end = line.find('\t', start);
+		size_t i = std::stoul(line.substr(start, end - start));
+		setting.taxa[i] = std::stoul(line.substr(end + 1));
+		setting.num_classified++;
+	}
+}
+
+/* marks the settings that are not dominated by another setting that is at least as fast and agrees at least as much
+ * with the most sensitive setting, and better in one of both */
+void mark_pareto_front(std::vector<TuneSetting> & settings) {
+	for(auto & a : settings) {
+		a.pareto = true;
+		for(auto const & b : settings) {
+			if(b.seconds <= a.seconds && b.agreement >= a.agreement && (b.seconds < a.seconds || b.agreement > a.agreement)) {
+				a.pareto = false;
+				break;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+
+	Config * config = new Config();
+
+	std::unordered_map<uint64_t,uint64_t> * nodes = new std::unordered_map<uint64_t,uint64_t>();
+
+	std::string nodes_filename;
+	std::string fmi_filename;
+	std::string in1_filename;
+	std::string in2_filename;
+	std::string output_filename;
+	std::string modes_arg = "mem,greedy";
+	std::string mismatches_arg = "1,3,5";
+	std::string min_score_arg = "55,65,75";
+	std::string min_Evalue_arg = "0.01";
+	std::string min_fragment_length_arg = "11,12";
+	std::string SEG_arg = "on";
+	size_t num_reads = 10000;
+	int num_threads = 1;
+	bool verbose = false;
+
+	// --------------------- START ------------------------------------------------------------------
+	// Read command line params
+	int c;
+	while ((c = getopt(argc, argv, "hvpt:f:i:j:o:z:n:a:e:s:E:m:x:")) != -1) {
+		switch (c)  {
+			case 'h':
+				usage(argv[0]);
+			case 'v':
+				verbose = true; break;
+			case 'p':
+				config->input_is_protein = true; break;
+			case 't':
+				nodes_filename = optarg; break;
+			case 'f':
+				fmi_filename = optarg; break;
+			case 'i':
+				in1_filename = optarg; break;
+			case 'j':
+				in2_filename = optarg; break;
+			case 'o':
+				output_filename = optarg; break;
+			case 'a':
+				modes_arg = optarg; break;
+			case 'e':
+				mismatches_arg = optarg; break;
+			case 's':
+				min_score_arg = optarg; break;
+			case 'E':
+				min_Evalue_arg = optarg; break;
+			case 'm':
+				min_fragment_length_arg = optarg; break;
+			case 'x':
+				SEG_arg = optarg; break;
+			case 'z': {
+									try {
+										num_threads = std::stoi(optarg);
+										if(num_threads <= 0) {  error("Number of threads (-z) must be greater than 0."); usage(argv[0]); }
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -z " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -z " << optarg << std::endl;
+									}
+									break;
+								}
+			case 'n': {
+									try {
+										int n = std::stoi(optarg);
+										if(n <= 0) {  error("Number of reads (-n) must be greater than 0."); usage(argv[0]); }
+										num_reads = (size_t)n;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -n " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -n " << optarg << std::endl;
+									}
+									break;
+								}
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(nodes_filename.length() == 0) { error("Please specify the location of the nodes.dmp file, using the -t option."); usage(argv[0]); }
+	if(fmi_filename.length() == 0) { error("Please specify the location of the FMI file, using the -f option."); usage(argv[0]); }
+	if(in1_filename.length() == 0) { error("Please specify the location of the input file, using the -i option."); usage(argv[0]); }
+	if(config->input_is_protein && in2_filename.length() > 0) { error("Protein input only supports one input file."); usage(argv[0]); }
+
+	// the grid of settings, in which parameters that are not used by a run mode are not varied
+	std::vector<unsigned int> mismatches = parse_int_list(mismatches_arg, 'e', 0, argv[0]);
+	std::vector<unsigned int> min_scores = parse_int_list(min_score_arg, 's', 1, argv[0]);
+	std::vector<unsigned int> min_fragment_lengths = parse_int_list(min_fragment_length_arg, 'm', 1, argv[0]);
+	std::vector<double> min_Evalues;
+	for(auto const & item : split_list(min_Evalue_arg)) {
+		try {
+			double value = std::stod(item);
+			if(value <= 0.0) { error("E-value thresholds in -E must be greater than 0."); usage(argv[0]); }
+			min_Evalues.push_back(value);
+		}
+		catch(const std::invalid_argument& ia) {
+			error("Invalid numerical argument in -E " + item);
+			usage(argv[0]);
+		}
+		catch (const std::out_of_range& oor) {
+			error("Invalid numerical argument in -E " + item);
+			usage(argv[0]);
+		}
+	}
+	if(min_Evalues.empty()) { error("Option -E needs at least one value."); usage(argv[0]); }
+	std::vector<bool> SEGs;
+	for(auto const & item : split_list(SEG_arg)) {
+		if(item == "on") SEGs.push_back(true);
+		else if(item == "off") SEGs.push_back(false);
+		else { error("Values in -x must be either on or off."); usage(argv[0]); }
+	}
+	if(SEGs.empty()) { error("Option -x needs at least one value."); usage(argv[0]); }
+
+	std::vector<TuneSetting> settings;
+	for(auto const & mode_name : split_list(modes_arg)) {
+		Mode mode;
+		if(mode_name == "mem") mode = MEM;
+		else if(mode_name == "greedy") mode = GREEDY;
+		else if(mode_name == "bnb") mode = BNB;
+		else { error("-a must be a comma-separated list of valid modes."); usage(argv[0]); }
+		for(bool SEG : SEGs) {
+			for(unsigned int m : min_fragment_lengths) {
+				TuneSetting setting;
+				setting.mode = mode;
+				setting.SEG = SEG;
+				setting.min_fragment_length = m;
+				if(mode == MEM) {
+					settings.push_back(setting);
+					continue;
+				}
+				for(unsigned int e : mismatches) {
+					for(unsigned int s : min_scores) {
+						for(double E : min_Evalues) {
+							setting.mismatches = e;
+							setting.min_score = s;
+							setting.min_Evalue = E;
+							settings.push_back(setting);
+						}
+					}
+				}
+			}
+		}
+	}
+	if(settings.empty()) { error("Please specify at least one run mode, using the -a option."); usage(argv[0]); }
+
+	std::vector<std::string> names1, names2, sequences1, sequences2;
+	read_sample(in1_filename, num_reads, names1, sequences1);
+	if(in2_filename.length() > 0) {
+		read_sample(in2_filename, num_reads, names2, sequences2);
+		if(names1 != names2) { error("Read names are not identical between the two input files. Probably reads are not in the same order in both files."); exit(EXIT_FAILURE); }
+	}
+	if(sequences1.empty()) { error("No reads found in file " + in1_filename); exit(EXIT_FAILURE); }
+	if(verbose) std::cerr << getCurrentTime() << " Read " << sequences1.size() << " reads from sample" << std::endl;
+
+	config->nodes = nodes;
+	config->verbose = false; // no match details are needed in the output
+
+	if(verbose) std::cerr << getCurrentTime() << " Reading database" << std::endl;
+	std::ifstream nodes_file;
+	nodes_file.open(nodes_filename.c_str());
+	if(!nodes_file.is_open()) { error("Could not open file " + nodes_filename); exit(EXIT_FAILURE); }
+	if(verbose) std::cerr << " Reading taxonomic tree from file " << nodes_filename << std::endl;
+	parseNodesDmp(*nodes,nodes_file);
+	nodes_file.close();
+
+	readFMI(fmi_filename,config);
+	// SEG parameters are always allocated, because settings with and without SEG are run with the same index
+	config->SEG = true;
+	config->init();
+
+	for(size_t i = 0; i < settings.size(); i++) {
+		run_setting(config, settings[i], sequences1, sequences2, num_threads);
+		if(verbose) std::cerr << getCurrentTime() << " Setting " << (i + 1) << " of " << settings.size() << ": " << settings[i].num_classified << " reads classified in " << settings[i].seconds << " s" << std::endl;
+	}
+	config->SEG = true;
+
+	// the most sensitive setting classifies the most reads, ties go to the setting listed first
+	size_t reference = 0;
+	for(size_t i = 1; i < settings.size(); i++) {
+		if(settings[i].num_classified > settings[reference].num_classified) reference = i;
+	}
+	for(auto & setting : settings) {
+		uint64_t num_agree = 0;
+		for(size_t i = 0; i < setting.taxa.size(); i++) {
+			if(setting.taxa[i] == settings[reference].taxa[i]) num_agree++;
+		}
+		setting.agreement = (double)num_agree / (double)setting.taxa.size();
+	}
+	mark_pareto_front(settings);
+
+	std::ostream * out_stream = &std::cout;
+	std::ofstream out_file;
+	if(output_filename.length() > 0) {
+		out_file.open(output_filename);
+		if(!out_file.is_open()) { error("Could not open file " + output_filename + " for writing"); exit(EXIT_FAILURE); }
+		out_stream = &out_file;
+	}
+	std::vector<size_t> order(settings.size());
+	for(size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return settings[a].seconds < settings[b].seconds; });
+
+	*out_stream << "pareto\tmode\tm\te\ts\tE\tSEG\treads_per_s\tclassified\tagreement\tcommand_line_options\n";
+	for(size_t i : order) {
+		const TuneSetting & s = settings[i];
+		std::ostringstream options;
+		options << "-a " << (s.mode == MEM ? "mem" : s.mode == BNB ? "bnb" : "greedy") << " -m " << s.min_fragment_length;
+		if(s.mode != MEM) options << " -e " << s.mismatches << " -s " << s.min_score << " -E " << s.min_Evalue;
+		options << (s.SEG ? " -x" : " -X");
+		*out_stream << (s.pareto ? "*" : "") << (i == reference ? "R" : "") << "\t"
+			<< (s.mode == MEM ? "mem" : s.mode == BNB ? "bnb" : "greedy") << "\t" << s.min_fragment_length << "\t";
+		if(s.mode == MEM) *out_stream << "-\t-\t-\t";
+		else *out_stream << s.mismatches << "\t" << s.min_score << "\t" << s.min_Evalue << "\t";
+		*out_stream << (s.SEG ? "on" : "off") << "\t" << (uint64_t)((double)s.taxa.size() / s.seconds) << "\t"
+			<< (double)s.num_classified / (double)s.taxa.size() << "\t" << s.agreement << "\t" << options.str() << "\n";
+	}
+	out_stream->flush();
+	if(output_filename.length() > 0) out_file.close();
+
+	delete config;
+	delete nodes;
+	return EXIT_SUCCESS;
+}
+
+void usage(char *progname) {
+	print_usage_header();
+	fprintf(stderr, "Usage:\n   %s -t nodes.dmp -f kaiju_db.fmi -i reads.fastq [-j reads2.fastq]\n", progname);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Mandatory arguments:\n");
+	fprintf(stderr, "   -t FILENAME   Name of nodes.dmp file\n");
+	fprintf(stderr, "   -f FILENAME   Name of database (.fmi) file\n");
+	fprintf(stderr, "   -i FILENAME   Name of input file containing reads in FASTA or FASTQ format\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Optional arguments:\n");
+	fprintf(stderr, "   -j FILENAME   Name of second input file for paired-end reads\n");
+	fprintf(stderr, "   -o FILENAME   Name of output file. If not specified, output will be printed to STDOUT\n");
+	fprintf(stderr, "   -n INT        Number of reads from the beginning of the input file(s) used as sample (default: 10000)\n");
+	fprintf(stderr, "   -z INT        Number of parallel threads for classification (default: 1)\n");
+	fprintf(stderr, "   -p            Input sequences are protein sequences\n");
+	fprintf(stderr, "   -v            Enable verbose output\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Comma-separated parameter values, all combinations of them are tested:\n");
+	fprintf(stderr, "   -a STRING     Run modes \"mem\", \"greedy\", or \"bnb\" (default: mem,greedy)\n");
+	fprintf(stderr, "   -m STRING     Minimum match lengths (default: 11,12)\n");
+	fprintf(stderr, "   -e STRING     Numbers of mismatches in Greedy and BNB modes (default: 1,3,5)\n");
+	fprintf(stderr, "   -s STRING     Minimum match scores in Greedy and BNB modes (default: 55,65,75)\n");
+	fprintf(stderr, "   -E STRING     Minimum E-values in Greedy and BNB modes (default: 0.01)\n");
+	fprintf(stderr, "   -x STRING     SEG low complexity filter \"on\" or \"off\" (default: on)\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "The output table lists the settings sorted by speed. The setting classifying the most reads is marked\n");
+	fprintf(stderr, "with R and the settings on the Pareto front of speed and agreement with it are marked with *.\n");
+	exit(EXIT_FAILURE);
+}
@@ -49,6 +49,61 @@ extern "C" {
 
 void usage(char *progname);
 
+gzFile open_bin_file(const std::string & filename) {
+	gzFile f = gzopen(filename.c_str(), "wb");
+	if(f == NULL) { error("Could not open file " + filename + " for writing"); exit(EXIT_FAILURE); }
+	return f;
+}
+
+/* prints percentiles of the classification time per read */
+void write_latency_report(const LatencyHistogram & latency) {
+	std::cerr << "Classification time per read in microseconds for " << latency.num << " reads: p50=" << latency.quantile(0.5) / 1000
+		<< " p90=" << latency.quantile(0.9) / 1000 << " p99=" << latency.quantile(0.99) / 1000 << " p99.9=" << latency.quantile(0.999) / 1000
+		<< " max=" << latency.max / 1000 << std::endl;
+}
+
+/* writes the records of the slowest reads, which can be used as input to Kaiju for reproducing their search */
+void write_slow_reads(const std::string & filename, const std::vector<SlowRead> & slow_reads, bool second) {
+	std::ofstream out_file(filename);
+	if(!out_file.is_open()) { error("Could not open file " + filename + " for writing"); exit(EXIT_FAILURE); }
+	for(auto const & r : slow_reads) out_file << (second ? r.record2 : r.record1);
+	out_file.close();
+	if(out_file.fail()) error("Could not write to file " + filename);
+}
+
+/* sorts a batch of reads by their peptide minimizer, such that reads with similar sequences are
+ * searched one after another and hit the same parts of the index, and hands them to the consumer threads */
+void dispatch_batch(std::vector<ReadItem *> & batch, Config * config, ProducerConsumerQueue<ReadItem*>* queue) {
+	if(batch.empty()) return;
+	std::vector<std::pair<uint64_t,ReadItem *>> keys;
+	keys.reserve(batch.size());
+	for(auto item : batch) {
+		uint64_t m = peptide_minimizer(item->sequence1, 6);
+		if(item->paired) m = std::min(m, peptide_minimizer(item->sequence2, 6));
+		keys.emplace_back(m, item);
+	}
+	std::stable_sort(keys.begin(), keys.end(), [](const std::pair<uint64_t,ReadItem *> & a, const std::pair<uint64_t,ReadItem *> & b) { return a.first < b.first; });
+	{
+		std::lock_guard<std::mutex> out_lock(ConsumerThread::output_mutex);
+		config->read_batches.emplace(batch.front()->serial / config->reorder_batch, ReadBatch(batch.size()));
+	}
+	for(auto & k : keys) {
+		queue->push(k.second);
+	}
+	batch.clear();
+}
+
+/* adds the read to the current batch of the pipeline, which is handed to the first stage when it is full */
+void add_to_pipeline(ReadItem * item, PipelineBatch * & batch, ProducerConsumerQueue<PipelineBatch*>* queue) {
+	const size_t pipeline_batch_size = 64;
+	if(batch == nullptr) batch = new PipelineBatch();
+	batch->reads.emplace_back(item);
+	if(batch->reads.size() >= pipeline_batch_size) {
+		queue->push(batch);
+		batch = nullptr;
+	}
+}
+
 int main(int argc, char** argv) {
 
 
@@ -58,10 +113,24 @@ int main(int argc, char** argv) {
 
 	std::string nodes_filename;
 	std::string fmi_filename;
+	std::vector<std::string> fmi_filenames;
+	std::string cascade_scores_arg;
+	std::string delta_filename;
+	std::string deleted_filename;
 	std::string sa_filename;
 	std::string in1_filename;
 	std::string in2_filename;
 	std::string output_filename;
+	std::string bin_taxa_arg;
+	std::string bin_prefix = "kaiju_bin_";
+	std::string profile_filename;
+	std::string trace_filename;
+	std::string trace_reads_arg;
+	bool trace_sample_given = false;
+	std::string slow_prefix;
+	size_t num_slow_reads = 100;
+	std::string pipeline_threads_arg;
+	std::vector<int> pipeline_threads; // number of threads for each stage of the pipeline, empty = not using the pipeline
 
 	int num_threads = 1;
 	bool verbose = false;
@@ -71,13 +140,15 @@ int main(int argc, char** argv) {
 	// --------------------- START ------------------------------------------------------------------
 	// Read command line params
 	int c;
-	while ((c = getopt(argc, argv, "a:hdpxXvn:m:e:E:l:t:f:i:j:s:z:o:")) != -1) {
+	while ((c = getopt(argc, argv, "a:hdpxXLvn:m:e:E:l:t:f:i:j:s:z:o:b:B:P:Q:R:T:S:N:W:C:K:Y:y:D:F:G:")) != -1) {
 		switch (c)  {
 			case 'a': {
 									if("mem" == std::string(optarg)) {
 										config->mode = MEM;
 										config->use_Evalue = false;
 									}
+									else if("greedy" == std::string(optarg)) config->mode = GREEDY;
+									else if("bnb" == std::string(optarg)) config->mode = BNB;
 									else { std::cerr << "-a must be a valid mode.\n"; usage(argv[0]); }
 									break;
 								}
@@ -93,10 +164,117 @@ int main(int argc, char** argv) {
 				config->SEG = true; break;
 			case 'X':
 				config->SEG = false; break;
+			case 'L':
+				config->mmap_index = true; break;
 			case 'o':
 				output_filename = optarg; break;
+			case 'b':
+				bin_taxa_arg = optarg; break;
+			case 'B':
+				bin_prefix = optarg; break;
+			case 'P':
+				profile_filename = optarg; break;
+			case 'T':
+				trace_filename = optarg; break;
+			case 'N':
+				trace_reads_arg = optarg; break;
+			case 'S': {
+									try {
+										int sample = std::stoi(optarg);
+										if(sample < 0) { error("Sampling interval (-S) must be >= 0."); usage(argv[0]); }
+										config->trace_sample = (unsigned int)sample;
+										trace_sample_given = true;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -S " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -S " << optarg << std::endl;
+									}
+									break;
+								}
+			case 'R': {
+									try {
+										int batch_size = std::stoi(optarg);
+										if(batch_size < 0) { error("Batch size (-R) must be >= 0."); usage(argv[0]); }
+										config->reorder_batch = (size_t)batch_size;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -R " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -R " << optarg << std::endl;
+									}
+									break;
+								}
+			case 'W': {
+									try {
+										int window = std::stoi(optarg);
+										if(window <= 0) { error("Number of interleaved reads (-W) must be greater than 0."); usage(argv[0]); }
+										config->interleave = (size_t)window;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -W " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -W " << optarg << std::endl;
+									}
+									break;
+								}
+			case 'C': {
+									try {
+										long cap = std::stol(optarg);
+										if(cap < 0) { error("Size of repetitive suffix intervals (-C) must not be negative."); usage(argv[0]); }
+										config->repeat_cap = (IndexType)cap;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -C " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -C " << optarg << std::endl;
+									}
+									break;
+								}
+			case 'Y':
+				slow_prefix = optarg; break;
+			case 'y': {
+									try {
+										int n = std::stoi(optarg);
+										if(n <= 0) { error("Number of slowest reads (-y) must be greater than 0."); usage(argv[0]); }
+										num_slow_reads = (size_t)n;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -y " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -y " << optarg << std::endl;
+									}
+									break;
+								}
+			case 'Q': {
+									try {
+										int sample = std::stoi(optarg);
+										if(sample <= 0) { error("Sampling interval (-Q) must be greater than 0."); usage(argv[0]); }
+										config->profile_sample = (unsigned int)sample;
+									}
+									catch(const std::invalid_argument& ia) {
+										std::cerr << "Invalid argument in -Q " << optarg << std::endl;
+									}
+									catch (const std::out_of_range& oor) {
+										std::cerr << "Invalid argument in -Q " << optarg << std::endl;
+									}
+									break;
+								}
 			case 'f':
 				fmi_filename = optarg; break;
+			case 'K':
+				cascade_scores_arg = optarg; break;
+			case 'D':
+				delta_filename = optarg; break;
+			case 'G':
+				pipeline_threads_arg = optarg; break;
+			case 'F':
+				deleted_filename = optarg; break;
 			case 't':
 				nodes_filename = optarg; break;
 			case 'i':
@@ -196,13 +374,123 @@ int main(int argc, char** argv) {
 	if(fmi_filename.length() == 0) { error("Please specify the location of the FMI file, using the -f option."); usage(argv[0]); }
 	if(in1_filename.length() == 0) { error("Please specify the location of the input file, using the -i option."); usage(argv[0]); }
 	if(paired && config->input_is_protein) { error("Protein input only supports one input file."); usage(argv[0]); }
+	if(config->reorder_batch > 0 && config->input_is_protein) { error("Reordering reads (-R) is only available for DNA input."); usage(argv[0]); }
+
+	/* parse comma-separated list of indexes for cascade mode */
+	{
+		size_t begin = 0;
+		size_t pos = -1;
+		do {
+			pos = fmi_filename.find(",",pos+1);
+			std::string filename = fmi_filename.substr(begin,(pos == std::string::npos) ? std::string::npos : pos - begin);
+			begin = pos+1;
+			if(filename.length() > 0) fmi_filenames.push_back(filename);
+		} while(pos != std::string::npos);
+	}
+	if(fmi_filenames.size() > 1) {
+		config->cascade.resize(fmi_filenames.size());
+		if(profile_filename.length() > 0) { error("The locate profile (-P) is not available when using multiple indexes."); usage(argv[0]); }
+	}
+	if(fmi_filenames.size() > 1 && (delta_filename.length() > 0 || deleted_filename.length() > 0)) { error("A delta index (-D) or deleted sequences (-F) can only be used with a single index in -f."); usage(argv[0]); }
+	if(delta_filename.length() > 0) {
+		if(profile_filename.length() > 0) { error("The locate profile (-P) is not available when using a delta index."); usage(argv[0]); }
+		config->interleave = 1; // locating cannot be deferred, because the matches from both indexes are compared
+	}
+	if(cascade_scores_arg.length() > 0) {
+		if(fmi_filenames.size() < 2) { error("Minimum scores given by -K require multiple indexes in -f."); usage(argv[0]); }
+		size_t begin = 0;
+		size_t pos = -1;
+		size_t stage = 0;
+		do {
+			pos = cascade_scores_arg.find(",",pos+1);
+			std::string score = cascade_scores_arg.substr(begin,(pos == std::string::npos) ? std::string::npos : pos - begin);
+			begin = pos+1;
+			if(stage >= fmi_filenames.size() - 1) { error("The number of minimum scores in -K must be lower than the number of indexes in -f."); usage(argv[0]); }
+			try {
+				config->cascade[stage++].min_score = (unsigned int)std::stoul(score);
+			}
+			catch(const std::exception& e) {
+				error("Invalid number " + score + " in -K.");
+				usage(argv[0]);
+			}
+		} while(pos != std::string::npos);
+	}
+
+	/* parse comma-separated numbers of threads for the stages of the pipeline */
+	if(pipeline_threads_arg.length() > 0) {
+		size_t begin = 0;
+		size_t pos = -1;
+		do {
+			pos = pipeline_threads_arg.find(",",pos+1);
+			std::string n = pipeline_threads_arg.substr(begin,(pos == std::string::npos) ? std::string::npos : pos - begin);
+			begin = pos+1;
+			try {
+				pipeline_threads.push_back(std::stoi(n));
+			}
+			catch(const std::exception& e) {
+				error("Invalid number " + n + " in -G.");
+				usage(argv[0]);
+			}
+			if(pipeline_threads.back() <= 0) { error("Numbers of threads in -G must be greater than 0."); usage(argv[0]); }
+		} while(pos != std::string::npos);
+		if(pipeline_threads.size() != 4) { error("Option -G needs four numbers of threads for the stages translate, search, locate, and output."); usage(argv[0]); }
+		if(fmi_filenames.size() > 1 || delta_filename.length() > 0) { error("The pipeline (-G) can only be used with a single index in -f."); usage(argv[0]); }
+		if(config->reorder_batch > 0 || profile_filename.length() > 0 || trace_filename.length() > 0 || slow_prefix.length() > 0) {
+			error("The pipeline (-G) cannot be used together with the options -R, -P, -T, or -Y.");
+			usage(argv[0]);
+		}
+	}
+
+	/* parse user-supplied list of taxon ids for binning reads */
+	if(bin_taxa_arg.length() > 0) {
+		size_t begin = 0;
+		size_t pos = -1;
+		do {
+			pos = bin_taxa_arg.find(",",pos+1);
+			std::string taxon = bin_taxa_arg.substr(begin,(pos == std::string::npos) ? std::string::npos : pos - begin);
+			begin = pos+1;
+			if(taxon.length()==0) continue;
+			try {
+				config->taxon_bins.emplace_back(std::stoul(taxon));
+			}
+			catch(const std::exception& e) {
+				error("Invalid taxon id in -b " + taxon); usage(argv[0]);
+			}
+		} while(pos != std::string::npos);
+	}
+	if(slow_prefix.length() > 0) {
+		config->num_slow_reads = num_slow_reads;
+		config->interleave = 1; // the time per read is only measured without interleaving
+	}
+	bool keep_records = !config->taxon_bins.empty() || config->num_slow_reads > 0;
+	if(profile_filename.length() > 0 && config->profile_sample == 0) config->profile_sample = 10;
+	if(profile_filename.length() == 0) config->profile_sample = 0;
+	if(config->profile_sample > 0) config->interleave = 1; // the profile is only collected in ids_from_SI()
+
+	/* parse user-supplied list of read names for tracing */
+	if(trace_reads_arg.length() > 0) {
+		size_t begin = 0;
+		size_t pos = -1;
+		do {
+			pos = trace_reads_arg.find(",",pos+1);
+			std::string read_name = trace_reads_arg.substr(begin,(pos == std::string::npos) ? std::string::npos : pos - begin);
+			begin = pos+1;
+			if(read_name.length() > 0) config->trace_reads.insert(read_name);
+		} while(pos != std::string::npos);
+	}
+	if(trace_filename.length() > 0 && config->trace_sample == 0 && config->trace_reads.empty()) {
+		if(trace_sample_given) { error("Tracing with -S 0 requires the names of the reads to be traced given by -N."); usage(argv[0]); }
+		config->trace_sample = 1000;
+	}
+	if((config->trace_sample > 0 || !config->trace_reads.empty()) && trace_filename.length() == 0) { error("Tracing reads with -S or -N requires a trace file given by -T."); usage(argv[0]); }
 
 	if(verbose) {
 		std::cerr << "Parameters: \n";
-		std::cerr << "  run mode: "  << ((config->mode==MEM) ? "MEM" : "Greedy") << "\n";
+		std::cerr << "  run mode: "  << ((config->mode==MEM) ? "MEM" : (config->mode==BNB) ? "Branch-and-bound" : "Greedy") << "\n";
 		std::cerr << "  minimum match length: " << config->min_fragment_length << "\n";
-		if(config->mode==GREEDY) {
-		std::cerr << "  seed length: " << config->seed_length << "\n";
+		if(config->mode!=MEM) {
+			if(config->mode==GREEDY)
+				std::cerr << "  seed length: " << config->seed_length << "\n";
 			std::cerr << "  minimum blosum62 score for matches: " << config->min_score << "\n";
 			std::cerr << "  minimum E-value: " << config->min_Evalue << "\n";
 			std::cerr << "  max number of mismatches within a match: "  << config->mismatches << "\n";
@@ -214,6 +502,10 @@ int main(int argc, char** argv) {
 			std::cerr << "  output file: " << output_filename << std::endl;
 		else
 			std::cerr << "  output to STDOUT" << std::endl;
+		if(config->num_slow_reads > 0)
+			std::cerr << "  writing the " << config->num_slow_reads << " slowest reads into files with prefix " << slow_prefix << std::endl;
+		if(!config->taxon_bins.empty())
+			std::cerr << "  binning reads for " << config->taxon_bins.size() << " taxa into files with prefix " << bin_prefix << std::endl;
 	}
 
 	config->nodes = nodes;
@@ -229,7 +521,38 @@ int main(int argc, char** argv) {
 	parseNodesDmp(*nodes,nodes_file);
 	nodes_file.close();
 
-	readFMI(fmi_filename,config);
+	if(!config->taxon_bins.empty()) {
+		label_node_intervals(*nodes, config->node2interval);
+		for(auto & bin : config->taxon_bins) {
+			auto it = config->node2interval.find(bin.taxon_id);
+			if(it == config->node2interval.end()) { error("Taxon id " + std::to_string(bin.taxon_id) + " given in -b is not contained in " + nodes_filename); exit(EXIT_FAILURE); }
+			bin.interval = it->second;
+		}
+	}
+
+	if(config->cascade.empty() && delta_filename.length() > 0) {
+		readFMI(delta_filename,config);
+		config->delta_bwt = config->bwt;
+		config->delta_fmi = config->fmi;
+		readFMI(fmi_filename,config);
+	}
+	else if(config->cascade.empty()) {
+		readFMI(fmi_filename,config);
+	}
+	else {
+		for(size_t i = 0; i < fmi_filenames.size(); i++) {
+			readFMI(fmi_filenames[i],config);
+			config->cascade[i].bwt = config->bwt;
+			config->cascade[i].fmi = config->fmi;
+		}
+		config->bwt = config->cascade[0].bwt;
+		config->fmi = config->cascade[0].fmi;
+	}
+
+	if(deleted_filename.length() > 0) {
+		uint64_t num_deleted = readDeletedSequences(deleted_filename, config);
+		if(verbose) std::cerr << " Marked " << num_deleted << " database sequences as deleted from file " << deleted_filename << std::endl;
+	}
 
 	config->init();
 
@@ -243,13 +566,38 @@ int main(int argc, char** argv) {
 		config->out_stream = &std::cout;
 	}
 
+	if(trace_filename.length() > 0) {
+		std::ofstream * trace_file = new std::ofstream();
+		trace_file->open(trace_filename);
+		if(!trace_file->is_open()) {  error("Could not open file " + trace_filename + " for writing"); exit(EXIT_FAILURE); }
+		config->trace_stream = trace_file;
+	}
+
 	ProducerConsumerQueue<ReadItem*>* myWorkQueue = new ProducerConsumerQueue<ReadItem*>(500);
-	std::deque<std::thread> threads;
-	std::deque<ConsumerThread *> threadpointers;
-	for(int i=0; i < num_threads; i++) {
-		ConsumerThread * p = new ConsumerThread(myWorkQueue, config);
-		threadpointers.push_back(p);
-		threads.push_back(std::thread(&ConsumerThread::doWork,p));
+	// in cascade mode, each further index has its own queue and threads, which get the reads passed on from the previous index
+	std::vector<ProducerConsumerQueue<ReadItem*>*> queues(1, myWorkQueue);
+	for(size_t s = 1; s < config->cascade.size(); s++) queues.push_back(new ProducerConsumerQueue<ReadItem*>(500));
+	std::vector<std::deque<std::thread>> threads(queues.size());
+	std::vector<std::deque<ConsumerThread *>> threadpointers(queues.size());
+	for(size_t s = 0; s < queues.size() && pipeline_threads.empty(); s++) {
+		for(int i=0; i < num_threads; i++) {
+			ConsumerThread * p = new ConsumerThread(queues[s], config, s, (s + 1 < queues.size()) ? queues[s+1] : nullptr);
+			threadpointers[s].push_back(p);
+			threads[s].push_back(std::thread(&ConsumerThread::doWork,p));
+		}
+	}
+	// in pipeline mode, batches of reads are passed through the queues between the stages, which have their own threads
+	std::vector<ProducerConsumerQueue<PipelineBatch*>*> pipeline_queues;
+	std::vector<std::deque<std::thread>> pipeline_stage_threads(pipeline_threads.size());
+	std::vector<std::deque<ConsumerThread *>> pipeline_threadpointers(pipeline_threads.size());
+	PipelineBatch * pipeline_batch = nullptr;
+	for(size_t s = 0; s < pipeline_threads.size(); s++) pipeline_queues.push_back(new ProducerConsumerQueue<PipelineBatch*>(64));
+	for(size_t s = 0; s < pipeline_threads.size(); s++) {
+		for(int i=0; i < pipeline_threads[s]; i++) {
+			ConsumerThread * p = new ConsumerThread(nullptr, config);
+			pipeline_threadpointers[s].push_back(p);
+			pipeline_stage_threads[s].push_back(std::thread(&ConsumerThread::doPipelineWork, p, (PipelineStage)s, pipeline_queues[s], (s + 1 < pipeline_queues.size()) ? pipeline_queues[s+1] : nullptr));
+		}
 	}
 
 	zstr::ifstream* in1_file = nullptr;
@@ -276,10 +624,15 @@ int main(int argc, char** argv) {
 	std::string name;
 	std::string sequence1;
 	std::string sequence2;
+	std::vector<ReadItem *> batch; // reads to be reordered
+	uint64_t num_reads = 0;
+	std::string record1;
+	std::string record2;
 	sequence1.reserve(2000);
 	if(paired) sequence2.reserve(2000);
 
-	if(verbose) std::cerr << getCurrentTime() << " Start classification using " << num_threads << " threads." << std::endl;
+	if(verbose && !pipeline_threads.empty()) std::cerr << getCurrentTime() << " Start classification using " << pipeline_threads[0] << " translate, " << pipeline_threads[1] << " search, " << pipeline_threads[2] << " locate, and " << pipeline_threads[3] << " output threads." << std::endl;
+	else if(verbose) std::cerr << getCurrentTime() << " Start classification using " << num_threads << " threads" << (queues.size() > 1 ? " per index." : ".") << std::endl;
 
 	while(getline(*in1_file,line_from_file)) {
 		if(line_from_file.length() == 0) { continue; }
@@ -293,8 +646,12 @@ int main(int argc, char** argv) {
 				exit(EXIT_FAILURE);
 			}
 			firstline_file1 = false;
+			for(auto & bin : config->taxon_bins) {
+				bin.file1 = open_bin_file(bin_prefix + std::to_string(bin.taxon_id) + (paired ? "_1" : "") + (isFastQ_file1 ? ".fastq.gz" : ".fasta.gz"));
+			}
 		}
 		if(isFastQ_file1) {
+			if(keep_records) record1 = line_from_file + "\n";
 			// remove '@' from beginning of line
 			line_from_file.erase(line_from_file.begin());
 			// delete suffixes like '/1' or ' 1:N:0:TAAGGCGA' from end of read name
@@ -306,10 +663,18 @@ int main(int argc, char** argv) {
 			sequence1 = line_from_file;
 			// skip + lin
 			in1_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-			// skip quality score line
-			in1_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			if(keep_records) {
+				// keep quality score line for the raw record
+				getline(*in1_file,line_from_file);
+				record1 += sequence1 + "\n+\n" + line_from_file + "\n";
+			}
+			else {
+				// skip quality score line
+				in1_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			}
 		}
 		else { //FASTA
+			if(keep_records) record1 = line_from_file + "\n";
 			// remove '>' from beginning of line
 			line_from_file.erase(line_from_file.begin());
 			// delete suffixes like '/1' or ' 1:N:0:TAAGGCGA' from end of read name
@@ -321,6 +686,7 @@ int main(int argc, char** argv) {
 			while(!(in1_file->peek()=='>' || in1_file->peek()==EOF)) {
 				getline(*in1_file,line_from_file);
 				sequence1.append(line_from_file);
+				if(keep_records) record1 += line_from_file + "\n";
 			}
 		} // end FASTA
 
@@ -345,8 +711,12 @@ int main(int argc, char** argv) {
 					exit(EXIT_FAILURE);
 				}
 				firstline_file2 = false;
+				for(auto & bin : config->taxon_bins) {
+					bin.file2 = open_bin_file(bin_prefix + std::to_string(bin.taxon_id) + "_2" + (isFastQ_file2 ? ".fastq.gz" : ".fasta.gz"));
+				}
 			}
 			if(isFastQ_file2) {
+				if(keep_records) record2 = line_from_file + "\n";
 				// remove '@' from beginning of line
 				line_from_file.erase(line_from_file.begin());
 				// delete suffixes like '/2' or ' 2:N:0:TAAGGCGA' from end of read name
@@ -361,10 +731,18 @@ int main(int argc, char** argv) {
 				sequence2 = line_from_file;
 				// skip + line
 				in2_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-				// skip quality score line
-				in2_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+				if(keep_records) {
+					// keep quality score line for the raw record
+					getline(*in2_file,line_from_file);
+					record2 += sequence2 + "\n+\n" + line_from_file + "\n";
+				}
+				else {
+					// skip quality score line
+					in2_file->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+				}
 			}
 			else { // FASTA
+				if(keep_records) record2 = line_from_file + "\n";
 				// remove '>' from beginning of line
 				line_from_file.erase(line_from_file.begin());
 				// delete suffixes like '/2' or ' 2:N:0:TAAGGCGA' from end of read name
@@ -378,17 +756,37 @@ int main(int argc, char** argv) {
 				while(!(in2_file->peek()=='>' || in2_file->peek()==EOF)) {
 					getline(*in2_file,line_from_file);
 					sequence2.append(line_from_file);
+					if(keep_records) record2 += line_from_file + "\n";
 				}
 			}
 			strip(sequence2); // remove non-alphabet chars
-			myWorkQueue->push(new ReadItem(name, sequence1, sequence2));
+			ReadItem * item = new ReadItem(name, sequence1, sequence2);
+			if(keep_records) {
+				item->record1.swap(record1);
+				item->record2.swap(record2);
+			}
+			if(config->reorder_batch > 0) {
+				item->serial = num_reads++;
+				batch.push_back(item);
+			}
+			else if(!pipeline_threads.empty()) add_to_pipeline(item, pipeline_batch, pipeline_queues[0]);
+			else myWorkQueue->push(item);
 		} // not paired
 		else {
-			myWorkQueue->push(new ReadItem(name, sequence1));
+			ReadItem * item = new ReadItem(name, sequence1);
+			if(keep_records) item->record1.swap(record1);
+			if(config->reorder_batch > 0) {
+				item->serial = num_reads++;
+				batch.push_back(item);
+			}
+			else if(!pipeline_threads.empty()) add_to_pipeline(item, pipeline_batch, pipeline_queues[0]);
+			else myWorkQueue->push(item);
 		}
+		if(config->reorder_batch > 0 && batch.size() == config->reorder_batch) dispatch_batch(batch, config, myWorkQueue);
 
 	} // end main loop around file1
 
+	dispatch_batch(batch, config, myWorkQueue);
 	myWorkQueue->pushedLast();
 
 	delete in1_file;
@@ -400,13 +798,32 @@ int main(int argc, char** argv) {
 		delete in2_file;
 	}
 
-	while(!threads.empty()) {
-		threads.front().join();
-		threads.pop_front();
-		delete threadpointers.front();
-		threadpointers.pop_front();
+	for(size_t s = 0; s < queues.size(); s++) {
+		while(!threads[s].empty()) {
+			threads[s].front().join();
+			threads[s].pop_front();
+			delete threadpointers[s].front();
+			threadpointers[s].pop_front();
+		}
+		// no more reads are passed on to the next index after all threads of this index are finished
+		if(s + 1 < queues.size()) queues[s+1]->pushedLast();
+	}
+	if(pipeline_batch != nullptr) pipeline_queues[0]->push(pipeline_batch);
+	for(size_t s = 0; s < pipeline_queues.size(); s++) {
+		pipeline_queues[s]->pushedLast();
+		while(!pipeline_stage_threads[s].empty()) {
+			pipeline_stage_threads[s].front().join();
+			pipeline_stage_threads[s].pop_front();
+			delete pipeline_threadpointers[s].front();
+			pipeline_threadpointers[s].pop_front();
+		}
 	}
 	if(verbose) std::cerr << getCurrentTime() << " Finished." << std::endl;
+	for(size_t s = 0; s + 1 < config->cascade.size(); s++) {
+		if(verbose) std::cerr << " Index " << fmi_filenames[s] << ": " << config->cascade[s].num_passed << " reads passed on to the next index" << std::endl;
+	}
+	if(verbose && !config->deleted.empty()) std::cerr << " Ignored matches to deleted database sequences: " << config->count_deleted << std::endl;
+	if(verbose && config->repeat_cap > 0) std::cerr << getCurrentTime() << " Repetitive suffix intervals: " << config->count_repetitive << " (" << config->count_repetitive_cached << " found in cache)" << std::endl;
 
 	config->out_stream->flush();
 	if(output_filename.length()>0) {
@@ -414,7 +831,33 @@ int main(int argc, char** argv) {
 		delete ((std::ofstream*)config->out_stream);
 	}
 
-	delete myWorkQueue;
+	if(config->trace_stream != nullptr) {
+		((std::ofstream*)config->trace_stream)->close();
+		delete ((std::ofstream*)config->trace_stream);
+	}
+
+	if(profile_filename.length() > 0) {
+		if(verbose) std::cerr << getCurrentTime() << " Writing locate profile to file " << profile_filename << std::endl;
+		write_profile_report(profile_filename, config);
+	}
+
+	for(auto & bin : config->taxon_bins) {
+		if(verbose) std::cerr << " Taxon " << bin.taxon_id << ": " << bin.num_reads << " reads written to bin" << std::endl;
+		if(bin.file1 != NULL && gzclose(bin.file1) != Z_OK) error("Could not close output file for taxon " + std::to_string(bin.taxon_id));
+		if(bin.file2 != NULL && gzclose(bin.file2) != Z_OK) error("Could not close output file for taxon " + std::to_string(bin.taxon_id));
+	}
+
+	if(config->num_slow_reads > 0) {
+		write_latency_report(config->latency);
+		std::sort(config->slow_reads.begin(), config->slow_reads.end(), std::greater<SlowRead>());
+		if(config->slow_reads.size() > config->num_slow_reads) config->slow_reads.resize(config->num_slow_reads);
+		write_slow_reads(slow_prefix + (paired ? "_1" : "") + (isFastQ_file1 ? ".fastq" : ".fasta"), config->slow_reads, false);
+		if(paired) write_slow_reads(slow_prefix + "_2" + (isFastQ_file2 ? ".fastq" : ".fasta"), config->slow_reads, true);
+		if(verbose) std::cerr << " Wrote " << config->slow_reads.size() << " slowest reads into files with prefix " << slow_prefix << std::endl;
+	}
+
+	for(auto queue : queues) delete queue;
+	for(auto queue : pipeline_queues) delete queue;
 	delete config;
 	delete nodes;
 	return EXIT_SUCCESS;
@@ -426,21 +869,48 @@ void usage(char *progname) {
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Mandatory arguments:\n");
 	fprintf(stderr, "   -t FILENAME   Name of nodes.dmp file\n");
-	fprintf(stderr, "   -f FILENAME   Name of database (.fmi) file\n");
+	fprintf(stderr, "   -f FILENAME   Name of database (.fmi) file, or comma-separated list of files for classifying\n");
+	fprintf(stderr, "                 reads that are not classified with the first database against the next one\n");
 	fprintf(stderr, "   -i FILENAME   Name of input file containing reads in FASTA or FASTQ format\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Optional arguments:\n");
 	fprintf(stderr, "   -j FILENAME   Name of second input file for paired-end reads\n");
 	fprintf(stderr, "   -o FILENAME   Name of output file. If not specified, output will be printed to STDOUT\n");
 	fprintf(stderr, "   -z INT        Number of parallel threads for classification (default: 1)\n");
-	fprintf(stderr, "   -a STRING     Run mode, either \"mem\"  or \"greedy\" (default: greedy)\n");
-	fprintf(stderr, "   -e INT        Number of mismatches allowed in Greedy mode (default: 3)\n");
+	fprintf(stderr, "   -a STRING     Run mode, either \"mem\", \"greedy\", or \"bnb\" (default: greedy)\n");
+	fprintf(stderr, "   -e INT        Number of mismatches allowed in Greedy and BNB modes (default: 3)\n");
 	fprintf(stderr, "   -m INT        Minimum match length (default: 11)\n");
 	fprintf(stderr, "   -s INT        Minimum match score in Greedy mode (default: 65)\n");
 	fprintf(stderr, "   -E FLOAT      Minimum E-value in Greedy mode (default: 0.01)\n");
 	fprintf(stderr, "   -x            Enable SEG low complexity filter (enabled by default)\n");
 	fprintf(stderr, "   -X            Disable SEG low complexity filter\n");
 	fprintf(stderr, "   -p            Input sequences are protein sequences\n");
+	fprintf(stderr, "   -L            Low-memory mode: only keep BWT and FM-index in RAM, read suffix array from disk\n");
+	fprintf(stderr, "   -b STRING     Write reads classified within the subtree of the given comma-separated taxon ids\n");
+	fprintf(stderr, "                 to one gzipped FASTQ/FASTA file per taxon\n");
+	fprintf(stderr, "   -B STRING     File name prefix for -b output files (default: kaiju_bin_)\n");
+	fprintf(stderr, "   -P FILENAME   Write a report of the database sequences ranked by the time spent on locating them\n");
+	fprintf(stderr, "   -Q INT        Sample every INT-th suffix array interval for the report in -P (default: 10)\n");
+	fprintf(stderr, "   -W INT        Interleave the suffix array lookups of INT reads per thread for hiding memory latency\n");
+	fprintf(stderr, "                 (default: 16, 1 = disabled)\n");
+	fprintf(stderr, "   -K STRING     Comma-separated minimum scores (match lengths in MEM mode) for accepting the classification\n");
+	fprintf(stderr, "                 with each but the last database in -f, other reads go on to the next database (default: 0)\n");
+	fprintf(stderr, "   -D FILENAME   Name of delta database (.fmi) file with sequences added after building the database in -f,\n");
+	fprintf(stderr, "                 which is searched in addition to the database in -f\n");
+	fprintf(stderr, "   -F FILENAME   Name of file with names or accessions of deleted sequences in the database in -f, one per line,\n");
+	fprintf(stderr, "                 whose matches are ignored\n");
+	fprintf(stderr, "   -C INT        Only locate INT rows spread over suffix intervals with more than INT rows and cache\n");
+	fprintf(stderr, "                 the result for repetitive matches (default: 0 = disabled)\n");
+	fprintf(stderr, "   -Y STRING     Measure the classification time of each read, print percentiles, and write the slowest reads\n");
+	fprintf(stderr, "                 with their search statistics to FASTQ/FASTA files with this prefix\n");
+	fprintf(stderr, "   -y INT        Number of slowest reads written by -Y (default: 100)\n");
+	fprintf(stderr, "   -T FILENAME   Write a trace of the search steps for a sample of reads as one JSON object per line\n");
+	fprintf(stderr, "   -S INT        Trace a pseudo-random sample of one in INT reads in -T (default: 1000, 0 = only reads in -N)\n");
+	fprintf(stderr, "   -N STRING     Always trace the reads with the given comma-separated names in -T\n");
+	fprintf(stderr, "   -G STRING     Run the classification as a pipeline with the given comma-separated numbers of threads for the\n");
+	fprintf(stderr, "                 stages translate, search, locate, and output, e.g. 2,8,4,1, instead of the threads given by -z\n");
+	fprintf(stderr, "   -R INT        Read INT reads at a time and search them ordered by sequence similarity for better\n");
+	fprintf(stderr, "                 cache usage, output is in input order (default: 0 = disabled)\n");
 	fprintf(stderr, "   -v            Enable verbose output\n");
 	//fprintf(stderr, "   -d            Enable debug output.\n");
 	exit(EXIT_FAILURE);
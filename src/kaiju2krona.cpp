@@ -13,6 +13,7 @@
 #include <stdexcept>
 
 #include "util.hpp"
+#include "InputFile.hpp"
 
 void usage(char *progname);
 
@@ -105,8 +106,7 @@ int main(int argc, char** argv) {
 
 	if(verbose) std::cerr << "Processing " << in1_filename <<"..." << "\n";
 
-	std::ifstream in1_file;
-	in1_file.open(in1_filename);
+	InputFile in1_file(in1_filename);
 	if(!in1_file.is_open()) {  error("Could not open file " + in1_filename); exit(EXIT_FAILURE); }
 
 	std::unordered_map<uint64_t, uint64_t> node2hitcount;
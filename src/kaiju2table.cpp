@@ -23,6 +23,7 @@
 #include <inttypes.h>
 
 #include "util.hpp"
+#include "InputFile.hpp"
 
 void usage(char *progname);
 
@@ -45,7 +46,8 @@ int main(int argc, char** argv) {
 	bool filter_unclassified = false;
 	bool full_path = false;
 	bool verbose = false;
-	std::string rank;
+	std::string ranks_target_arg;
+	std::vector<std::string> ranks;
 	std::vector<std::string> input_filenames;
 
 	bool specified_ranks = false;
@@ -67,7 +69,7 @@ int main(int argc, char** argv) {
 			case 'u':
 				filter_unclassified = true; break;
 			case 'r':
-				rank = optarg; break;
+				ranks_target_arg = optarg; break;
 			case 'p':
 				full_path = true; break;
 			case 'o':
@@ -116,10 +118,24 @@ int main(int argc, char** argv) {
 	if(names_filename.length() == 0) { error("Please specify the location of the names.dmp file with the -n option."); usage(argv[0]); }
 	if(nodes_filename.length() == 0) { error("Please specify the location of the nodes.dmp file with the -t option."); usage(argv[0]); }
 	if(out_filename.length() == 0) { error("Please specify the name of the output file with the -o option."); usage(argv[0]); }
-	if(rank.length() == 0) { error("Please specify the rank (phylum, class, order, family, genus, or species) with the -r option."); usage(argv[0]); }
+	if(ranks_target_arg.length() == 0) { error("Please specify the rank (phylum, class, order, family, genus, or species) with the -r option."); usage(argv[0]); }
 	if(ranks_arg.length() > 0 && full_path) { error("Please use either option -r or -l, but not both of them."); usage(argv[0]); }
-	if(!(rank.compare("phylum")==0 || rank.compare("class")==0 || rank.compare("order")==0 || rank.compare("family")==0 || rank.compare("genus")==0 || rank.compare("species")==0)) {
-		error("Rank must be one of: phylum, class, order, family, genus, species."); usage(argv[0]);
+
+	/* parse comma-separated list of target ranks */
+	{
+		size_t begin = 0;
+		size_t pos;
+		do {
+			pos = ranks_target_arg.find(",",begin);
+			std::string rank = ranks_target_arg.substr(begin, pos == std::string::npos ? std::string::npos : pos - begin);
+			begin = pos+1;
+			if(rank.length()==0) continue;
+			if(!(rank.compare("phylum")==0 || rank.compare("class")==0 || rank.compare("order")==0 || rank.compare("family")==0 || rank.compare("genus")==0 || rank.compare("species")==0)) {
+				error("Rank must be one of: phylum, class, order, family, genus, species."); usage(argv[0]);
+			}
+			if(std::find(ranks.begin(),ranks.end(),rank) == ranks.end()) ranks.emplace_back(rank);
+		} while(pos != std::string::npos);
+		if(ranks.size() == 0) { error("Please specify the rank (phylum, class, order, family, genus, or species) with the -r option."); usage(argv[0]); }
 	}
 	if(min_read_count < 0) {
 		error("Min required read count (-c) must be >= 0"); usage(argv[0]);
@@ -149,8 +165,10 @@ int main(int argc, char** argv) {
 			ranks_list.emplace_back(rankname);
 		}
 
-		if(ranks_set.count(rank)==0) {
-			error("Specified rank " + rank + " is not contained in rank list supplied with option -l"); usage(argv[0]);
+		for(auto const & rank : ranks) {
+			if(ranks_set.count(rank)==0) {
+				error("Specified rank " + rank + " is not contained in rank list supplied with option -l"); usage(argv[0]);
+			}
 		}
 	}
 
@@ -174,13 +192,15 @@ int main(int argc, char** argv) {
 	FILE * report_file = fopen(out_filename.c_str(),"w");
 	if(report_file==NULL) {  std::cerr << "Could not open file " << out_filename << " for writing" << std::endl; exit(EXIT_FAILURE); }
 	// print output file header row
-	fprintf(report_file,"file\tpercent\treads\ttaxon_id\ttaxon_name\n");
+	if(ranks.size() > 1)
+		fprintf(report_file,"file\trank\tpercent\treads\ttaxon_id\ttaxon_name\n");
+	else
+		fprintf(report_file,"file\tpercent\treads\ttaxon_id\ttaxon_name\n");
 
 	/* go through each input file */
 	for(auto const & filename : input_filenames) {
-		std::ifstream in_file;
-		in_file.open(filename);
-		if(!in_file) {  std::cerr << "Could not open file " << filename << std::endl; exit(EXIT_FAILURE); }
+		InputFile in_file(filename);
+		if(!in_file.is_open()) {  std::cerr << "Could not open file " << filename << std::endl; exit(EXIT_FAILURE); }
 
 		if(verbose) std::cerr << "Processing " << filename <<"..." << "\n";
 
@@ -239,125 +259,130 @@ int main(int argc, char** argv) {
 			totalreads -= unclassified;
 		}
 
-		// Go through node2summarizedhits and check each node at the specified rank
-		// if it is above threshold, then add it to a sorted map for later printing
-		uint64_t reads_at_rank_sum = 0;
-		uint64_t reads_at_rank_below_percent_threshold = 0;
-		uint64_t reads_at_rank_below_count_threshold = 0;
-
-		std::multimap<uint64_t,uint64_t ,std::greater<uint64_t>> sorted_count2ids;
-		for(auto const it : node2summarizedhits) {
-			uint64_t id = it.first;
-			uint64_t count = it.second;
-			if(is_ancestor(nodes,taxonid_viruses,id)) { // viruses are always included regardless of count or rank
-				sorted_count2ids.emplace(count,id);
-				continue;
-			}
-			if(node2rank.count(id)==0) { std::cerr << "Error: No rank specified for taxonid " << id << std::endl; continue; }
-			if(rank == node2rank[id]) {
-				if((int)count >= min_read_count) {
-					float percent = (float)count/(float)totalreads*100;
-					if(percent >= min_percent)
-						sorted_count2ids.emplace(count,id);
-					else
-						reads_at_rank_below_percent_threshold += count;
-				} else {
-					reads_at_rank_below_count_threshold += count;
+		for(auto const & rank : ranks) {
+			// in multi-rank mode, the rank is printed in the second column
+			std::string prefix = (ranks.size() > 1) ? filename + "\t" + rank : filename;
+
+			// Go through node2summarizedhits and check each node at the specified rank
+			// if it is above threshold, then add it to a sorted map for later printing
+			uint64_t reads_at_rank_sum = 0;
+			uint64_t reads_at_rank_below_percent_threshold = 0;
+			uint64_t reads_at_rank_below_count_threshold = 0;
+
+			std::multimap<uint64_t,uint64_t ,std::greater<uint64_t>> sorted_count2ids;
+			for(auto const it : node2summarizedhits) {
+				uint64_t id = it.first;
+				uint64_t count = it.second;
+				if(is_ancestor(nodes,taxonid_viruses,id)) { // viruses are always included regardless of count or rank
+					sorted_count2ids.emplace(count,id);
+					continue;
+				}
+				if(node2rank.count(id)==0) { std::cerr << "Error: No rank specified for taxonid " << id << std::endl; continue; }
+				if(rank == node2rank[id]) {
+					if((int)count >= min_read_count) {
+						float percent = (float)count/(float)totalreads*100;
+						if(percent >= min_percent)
+							sorted_count2ids.emplace(count,id);
+						else
+							reads_at_rank_below_percent_threshold += count;
+					} else {
+						reads_at_rank_below_count_threshold += count;
+					}
+					reads_at_rank_sum += count;
 				}
-				reads_at_rank_sum += count;
 			}
-		}
 
-		if(filter_unclassified) {
-			assert(totalreads >= reads_at_rank_sum);
-		}
-		else {
-			assert(totalreads >= unclassified + reads_at_rank_sum);
-		}
+			if(filter_unclassified) {
+				assert(totalreads >= reads_at_rank_sum);
+			}
+			else {
+				assert(totalreads >= unclassified + reads_at_rank_sum);
+			}
 
-		uint64_t above = (filter_unclassified) ? totalreads - reads_at_rank_sum  : totalreads - unclassified - reads_at_rank_sum;
-		above -= total_virus_reads;
+			uint64_t above = (filter_unclassified) ? totalreads - reads_at_rank_sum  : totalreads - unclassified - reads_at_rank_sum;
+			above -= total_virus_reads;
 
-		/* ---------- print output ---------------- */
+			/* ---------- print output ---------------- */
 
-		for(auto const it : sorted_count2ids) {
-			if(!expand_viruses && is_ancestor(nodes,taxonid_viruses,it.second)) {
-				continue;
-			}
-			float percent = (float)it.first/(float)totalreads*100.0f;
-			fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\t%" PRIu64, filename.c_str(), percent, it.first, it.second);
-			if(full_path || specified_ranks) {
-				uint64_t id = it.second;
-				std::deque<std::string> lineage; // for full_path
-				std::map<std::string,std::string> curr_rank_values;
-				if(specified_ranks) { //set the values for all specified ranks to NA, which will be overwritten by the actual values if they are found
-					for(auto it : ranks_list) {
-						curr_rank_values.emplace(it,"NA");
-					}
+			for(auto const it : sorted_count2ids) {
+				if(!expand_viruses && is_ancestor(nodes,taxonid_viruses,it.second)) {
+					continue;
 				}
-				while(nodes.count(id)>0 && id != nodes.at(id)) {
-					std::string taxon_name;
-					if(specified_ranks) {
-						if(node2rank.count(id)==0 || node2rank.at(id)=="no rank") {  // no rank name
-							id = nodes.at(id);
-							continue;
+				float percent = (float)it.first/(float)totalreads*100.0f;
+				fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\t%" PRIu64, prefix.c_str(), percent, it.first, it.second);
+				if(full_path || specified_ranks) {
+					uint64_t id = it.second;
+					std::deque<std::string> lineage; // for full_path
+					std::map<std::string,std::string> curr_rank_values;
+					if(specified_ranks) { //set the values for all specified ranks to NA, which will be overwritten by the actual values if they are found
+						for(auto it : ranks_list) {
+							curr_rank_values.emplace(it,"NA");
 						}
-						std::string rank_name = node2rank.at(id);
-						if(ranks_set.count(rank_name)==0) { // rank name is not in specified list of ranks
-							id = nodes.at(id);
-							continue;
-						}
-						taxon_name = getTaxonNameFromId(node2name, id, names_filename);
-						curr_rank_values[rank_name] = taxon_name;
 					}
-					else { //full path
-						taxon_name = getTaxonNameFromId(node2name, id, names_filename);
-						lineage.emplace_front(taxon_name);
+					while(nodes.count(id)>0 && id != nodes.at(id)) {
+						std::string taxon_name;
+						if(specified_ranks) {
+							if(node2rank.count(id)==0 || node2rank.at(id)=="no rank") {  // no rank name
+								id = nodes.at(id);
+								continue;
+							}
+							std::string rank_name = node2rank.at(id);
+							if(ranks_set.count(rank_name)==0) { // rank name is not in specified list of ranks
+								id = nodes.at(id);
+								continue;
+							}
+							taxon_name = getTaxonNameFromId(node2name, id, names_filename);
+							curr_rank_values[rank_name] = taxon_name;
+						}
+						else { //full path
+							taxon_name = getTaxonNameFromId(node2name, id, names_filename);
+							lineage.emplace_front(taxon_name);
+						}
+						id = nodes.at(id);
 					}
-					id = nodes.at(id);
-				}
 
 
-				if(specified_ranks) { // full path just as single string
-					fprintf(report_file,"\t");
-					for(auto it : ranks_list) {
-						fprintf(report_file,"%s;", curr_rank_values[it].c_str());
+					if(specified_ranks) { // full path just as single string
+						fprintf(report_file,"\t");
+						for(auto it : ranks_list) {
+							fprintf(report_file,"%s;", curr_rank_values[it].c_str());
+						}
 					}
-				}
-				else { // full path just as single string
-					fprintf(report_file,"\t");
-					for(auto const it : lineage) {
-						fprintf(report_file,"%s;", it.c_str());
+					else { // full path just as single string
+						fprintf(report_file,"\t");
+						for(auto const it : lineage) {
+							fprintf(report_file,"%s;", it.c_str());
+						}
 					}
 				}
+				else {
+					std::string	name = getTaxonNameFromId(node2name, it.second, names_filename);
+					fprintf(report_file,"\t%s", name.c_str() );
+				}
+				fprintf(report_file,"\n");
+			}
+
+			if(!expand_viruses) {
+				float percent_viruses = total_virus_reads > 0 ? (float)total_virus_reads/(float)totalreads*100.0 : 0.0;
+				fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\t%" PRIu64 "\tViruses\n", prefix.c_str(), percent_viruses, total_virus_reads, taxonid_viruses);
+			}
+			{
+				float percent_above = above > 0 ? (float)above/(float)totalreads*100.0 : 0.0;
+				fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tcannot be assigned to a (non-viral) %s\n", prefix.c_str(), percent_above, above, rank.c_str());
+			}
+			if(min_read_count > 0) {
+				fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tbelong to a (non-viral) %s having less than %i reads\n",prefix.c_str(), (float)reads_at_rank_below_count_threshold/(float)totalreads*100.0, reads_at_rank_below_count_threshold, rank.c_str(), min_read_count);
+			}
+			if(min_percent > 0.0) {
+				fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tbelong to a (non-viral) %s with less than %g%% of all reads\n",prefix.c_str(), (float)reads_at_rank_below_percent_threshold/(float)totalreads*100.0, reads_at_rank_below_percent_threshold, rank.c_str(), min_percent);
+			}
+			if(filter_unclassified) {
+				fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tunclassified\n",prefix.c_str(), (float)unclassified/(float)(totalreads+unclassified)*100.0, unclassified );
 			}
 			else {
-				std::string	name = getTaxonNameFromId(node2name, it.second, names_filename);
-				fprintf(report_file,"\t%s", name.c_str() );
+				fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tunclassified\n",prefix.c_str(), (float)unclassified/(float)(totalreads)*100.0, unclassified );
 			}
-			fprintf(report_file,"\n");
-		}
-
-		if(!expand_viruses) {
-			float percent_viruses = total_virus_reads > 0 ? (float)total_virus_reads/(float)totalreads*100.0 : 0.0;
-			fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\t%" PRIu64 "\tViruses\n", filename.c_str(), percent_viruses, total_virus_reads, taxonid_viruses);
-		}
-		{
-			float percent_above = above > 0 ? (float)above/(float)totalreads*100.0 : 0.0;
-			fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tcannot be assigned to a (non-viral) %s\n", filename.c_str(), percent_above, above, rank.c_str());
-		}
-		if(min_read_count > 0) {
-			fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tbelong to a (non-viral) %s having less than %i reads\n",filename.c_str(), (float)reads_at_rank_below_count_threshold/(float)totalreads*100.0, reads_at_rank_below_count_threshold, rank.c_str(), min_read_count);
-		}
-		if(min_percent > 0.0) {
-			fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tbelong to a (non-viral) %s with less than %g%% of all reads\n",filename.c_str(), (float)reads_at_rank_below_percent_threshold/(float)totalreads*100.0, reads_at_rank_below_percent_threshold, rank.c_str(), min_percent);
-		}
-		if(filter_unclassified) {
-			fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tunclassified\n",filename.c_str(), (float)unclassified/(float)(totalreads+unclassified)*100.0, unclassified );
-		}
-		else {
-			fprintf(report_file,"%s\t%.6f\t%" PRIu64 "\tNA\tunclassified\n",filename.c_str(), (float)unclassified/(float)(totalreads)*100.0, unclassified );
-		}
+		} // end for each rank
 
 	} // end for each input file
 
@@ -375,6 +400,8 @@ void usage(char *progname) {
 	fprintf(stderr, "   -t FILENAME   Name of nodes.dmp file\n");
 	fprintf(stderr, "   -n FILENAME   Name of names.dmp file.\n");
 	fprintf(stderr, "   -r STRING     Taxonomic rank, must be one of: phylum, class, order, family, genus, species\n");
+	fprintf(stderr, "                 Multiple ranks can be given as comma-separated list, e.g. phylum,genus,species,\n");
+	fprintf(stderr, "                 in which case the output contains an additional column with the rank.\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Optional arguments:\n");
 	fprintf(stderr, "   -m FLOAT      Number in [0, 100], denoting the minimum required percentage for the taxon (except viruses) to be reported (default: 0.0)\n");
@@ -1,6 +1,10 @@
 /* This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh,
  * Kaiju is licensed under the GPLv3, see the file LICENSE. */
 
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
 #include "util.hpp"
 
 extern "C" {
@@ -76,6 +80,44 @@ bool is_ancestor(const std::unordered_map<uint64_t,uint64_t> & nodes, uint64_t n
 		return false;
 }
 
+void label_node_intervals(const std::unordered_map<uint64_t,uint64_t> & nodes, std::unordered_map<uint64_t,std::pair<uint32_t,uint32_t>> & node2interval) {
+		std::unordered_map<uint64_t,std::vector<uint64_t>> children;
+		std::vector<uint64_t> stack;
+		for(auto const & it : nodes) {
+			if(it.first == it.second || nodes.count(it.second)==0)
+				stack.push_back(it.first);
+			else
+				children[it.second].push_back(it.first);
+		}
+		node2interval.clear();
+		node2interval.reserve(nodes.size());
+		/* iterative DFS, a node is visited once when entering it (pre) and once when leaving it (last) */
+		std::vector<bool> leaving;
+		leaving.assign(stack.size(),false);
+		uint32_t counter = 0;
+		while(!stack.empty()) {
+			uint64_t node = stack.back();
+			bool leave = leaving.back();
+			stack.pop_back();
+			leaving.pop_back();
+			if(leave) {
+				node2interval[node].second = counter - 1;
+				continue;
+			}
+			node2interval[node] = std::make_pair(counter, counter);
+			counter++;
+			stack.push_back(node);
+			leaving.push_back(true);
+			auto ch = children.find(node);
+			if(ch != children.end()) {
+				for(auto const & child : ch->second) {
+					stack.push_back(child);
+					leaving.push_back(false);
+				}
+			}
+		}
+}
+
 void parseNodesDmp(std::unordered_map<uint64_t,uint64_t> & nodes, std::ifstream & nodes_file) {
 		nodes.reserve(2e6);
 		std::string line;
@@ -267,10 +309,116 @@ void readFMI(std::string fmi_filename, Config * config) {
 	if(config->verbose) std::cerr << " Reading index from file " << fmi_filename << std::endl;
 	FILE * fp = fopen(fmi_filename.c_str(),"r");
 	if(!fp) { error("Could not open file " + fmi_filename); exit(EXIT_FAILURE); }
-	BWT * b = readIndexes(fp);
+	BWT * b;
+	if(isBlockCompressedIndex(fp)) {
+		if(config->mmap_index) { error("Low-memory mode (-L) cannot be used with the compressed index " + fmi_filename); exit(EXIT_FAILURE); }
+		// all cores are used for decompression, because the index is loaded before classification starts
+		int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if(config->verbose) std::cerr << " Decompressing index using " << nthreads << " threads" << std::endl;
+		b = readIndexesBlocks(fp, nthreads);
+	}
+	else {
+		b = config->mmap_index ? readIndexesTiered(fp, 1) : readIndexes(fp);
+	}
 	fclose(fp);
 	if(config->debug) fprintf(stderr,"BWT of length %ld has been read with %d sequences, alphabet=%s\n", b->len, b->nseq, b->alphabet);
 	config->bwt = b;
 	config->fmi = b->f;
 
 }
+
+uint64_t readDeletedSequences(const std::string & filename, Config * config) {
+	std::ifstream in_file(filename);
+	if(!in_file.is_open()) { error("Could not open file " + filename); exit(EXIT_FAILURE); }
+	std::unordered_set<std::string> names;
+	std::string line;
+	while(getline(in_file, line)) {
+		line.erase(std::min(line.find_first_of(" \t\r"), line.length()));
+		if(line.length() > 0) names.insert(line);
+	}
+	in_file.close();
+
+	std::unordered_set<std::string> found;
+	uint64_t count = 0;
+	config->deleted.assign((size_t)config->bwt->nseq, false);
+	for(int iseq = 0; iseq < config->bwt->nseq; iseq++) {
+		const char * name = config->bwt->s->ids[iseq];
+		auto it = names.find(name);
+		if(it == names.end()) {
+			const char * pch = strrchr(name, '_');
+			if(pch == NULL) continue;
+			it = names.find(std::string(name, pch - name));
+			if(it == names.end()) continue;
+		}
+		config->deleted[(size_t)iseq] = true;
+		found.insert(*it);
+		count++;
+	}
+	if(found.size() < names.size())
+		std::cerr << "Warning: " << names.size() - found.size() << " of the names in file " << filename << " were not found in the database." << std::endl;
+	return count;
+}
+
+void write_profile_report(const std::string & filename, Config * config) {
+	std::ofstream out;
+	out.open(filename);
+	if(!out.is_open()) { error("Could not open file " + filename + " for writing"); return; }
+
+	std::vector<std::pair<int,SeqProfile>> ranked(config->seq_profile.begin(), config->seq_profile.end());
+	std::sort(ranked.begin(), ranked.end(), [](const std::pair<int,SeqProfile> & a, const std::pair<int,SeqProfile> & b) {
+			return (a.second.seconds != b.second.seconds) ? a.second.seconds > b.second.seconds : a.second.rows > b.second.rows; });
+
+	out << "# sampled 1 of every " << config->profile_sample << " suffix array intervals\n";
+	out << "rank\tsequence\tseconds\tlocated_rows\tintervals\tmean_interval_size\tmax_interval_size\n";
+	size_t rank = 0;
+	for(auto const & it : ranked) {
+		const SeqProfile & p = it.second;
+		out << ++rank << "\t" << config->bwt->s->ids[it.first] << "\t" << p.seconds << "\t" << p.rows << "\t" << p.intervals
+			<< "\t" << (p.intervals > 0 ? p.interval_size_sum / p.intervals : 0) << "\t" << p.interval_size_max << "\n";
+	}
+	out.close();
+}
+
+uint64_t peptide_minimizer(const std::string & dna, unsigned int k) {
+	// rank of the amino acid in ACDEFGHIKLMNPQRSTVWY for each codon in order TTT, TTC, TTA, ..., GGG, 255 for stop codons
+	static const uint8_t codon2rank[64] = {
+		4, 4, 9, 9, 15, 15, 15, 15, 19, 19, 255, 255, 1, 1, 255, 18,
+		9, 9, 9, 9, 12, 12, 12, 12, 6, 6, 13, 13, 14, 14, 14, 14,
+		7, 7, 7, 10, 16, 16, 16, 16, 11, 11, 8, 8, 15, 15, 14, 14,
+		17, 17, 17, 17, 0, 0, 0, 0, 2, 2, 3, 3, 5, 5, 5, 5 };
+	// T=0, C=1, A=2, G=3, so that the complement is n^2
+	static const uint8_t * nuc = [] {
+		static uint8_t t[256];
+		std::memset(t, 255, sizeof(t));
+		t['T'] = t['t'] = t['U'] = t['u'] = 0;
+		t['C'] = t['c'] = 1;
+		t['A'] = t['a'] = 2;
+		t['G'] = t['g'] = 3;
+		return t;
+	}();
+
+	const uint64_t mask = ((uint64_t)1 << (5 * k)) - 1;
+	uint64_t minimizer = UINT64_MAX;
+	const size_t len = dna.length();
+	for(int strand = 0; strand < 2; strand++) {
+		for(size_t frame = 0; frame < 3; frame++) {
+			uint64_t kmer = 0;
+			unsigned int valid = 0; // number of amino acids in kmer since last stop codon or invalid character
+			for(size_t i = frame; i + 3 <= len; i += 3) {
+				uint8_t n[3];
+				for(int j = 0; j < 3; j++) {
+					n[j] = (strand == 0) ? nuc[(uint8_t)dna[i+j]] : nuc[(uint8_t)dna[len-1-i-j]];
+					if(strand == 1 && n[j] != 255) n[j] ^= 2;
+				}
+				const uint8_t aa = (n[0] == 255 || n[1] == 255 || n[2] == 255) ? 255 : codon2rank[n[0] << 4 | n[1] << 2 | n[2]];
+				if(aa == 255) {
+					valid = 0;
+					continue;
+				}
+				kmer = ((kmer << 5) | aa) & mask;
+				if(++valid >= k && kmer < minimizer) minimizer = kmer;
+			}
+		}
+	}
+	return minimizer;
+}
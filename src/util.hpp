@@ -11,6 +11,8 @@
 #include <time.h>
 #include <unordered_map>
 #include <fstream>
+#include <vector>
+#include <utility>
 
 #include "Config.hpp"
 #include "version.hpp"
@@ -41,8 +43,23 @@ bool is_ancestor(const std::unordered_map<uint64_t,uint64_t> &, const std::strin
 /* returns true if node1 is ancestor of node2  or if node1==node2*/
 bool is_ancestor(const std::unordered_map<uint64_t,uint64_t> &, uint64_t, uint64_t);
 
+/* labels each node with its depth-first interval [pre,last], such that node1 is ancestor of node2 or node1==node2
+ * if and only if pre(node1) <= pre(node2) <= last(node1) */
+void label_node_intervals(const std::unordered_map<uint64_t,uint64_t> &, std::unordered_map<uint64_t,std::pair<uint32_t,uint32_t>> &);
+
 uint64_t lca_from_ids(Config *, std::unordered_map<uint64_t,unsigned int> &, const std::set<uint64_t> &);
 
 void readFMI(std::string fmi_filename, Config * config);
 
+/* marks the database sequences of config->bwt whose names, or accessions before the last '_' in the name,
+ * are listed in the file as deleted and returns the number of marked sequences */
+uint64_t readDeletedSequences(const std::string & filename, Config * config);
+
+/* writes the database sequences ranked by the sampled time spent on locating them */
+void write_profile_report(const std::string & filename, Config * config);
+
+/* lexicographically smallest amino acid k-mer (k <= 12) in the six-frame translation of a DNA sequence,
+ * packed as 5 bits per amino acid in alphabetical order, or UINT64_MAX if there is none */
+uint64_t peptide_minimizer(const std::string & dna, unsigned int k);
+
 #endif
@@ -0,0 +1,94 @@
+#!/usr/bin/env perl
+# This program writes synthetic protein sequences in FASTA format for
+# benchmarking the index construction with kaiju-mkbwt and kaiju-mkfmi.
+# Similar to real reference databases, the sequences contain gene families
+# with many diverged copies, a few highly abundant families, low-complexity
+# stretches of short tandem repeats and homopolymer runs.
+# The FASTA header contains a sequential number followed by a taxon id.
+# The output only depends on the given length and seed.
+#
+# This file is part of Kaiju, Copyright 2015-2022 Peter Menzel and Anders Krogh
+# Kaiju is licensed under the GPLv3, see the file LICENSE.
+#
+
+use strict;
+use warnings;
+
+if(!defined $ARGV[0] || $ARGV[0] !~ /^[0-9.]+$/) { die "Usage: $0 <million residues> [seed] > outfile.faa\n"; }
+my $total = int($ARGV[0] * 1e6);
+srand(defined $ARGV[1] ? $ARGV[1] : 42);
+
+# amino acid background frequencies in percent (UniProtKB)
+my %freq = (A=>8.25, R=>5.53, N=>4.06, D=>5.45, C=>1.37, Q=>3.93, E=>6.75, G=>7.07, H=>2.27, I=>5.96,
+            L=>9.66, K=>5.84, M=>2.42, F=>3.86, P=>4.70, S=>6.56, T=>5.34, W=>1.08, Y=>2.92, V=>6.87);
+my @aa = sort keys %freq;
+my @cumul;
+my $sum = 0;
+foreach(@aa) { $sum += $freq{$_}; push @cumul, $sum; }
+
+sub random_aa {
+	my $r = rand($sum);
+	for(my $i = 0; $i < @cumul; $i++) { return $aa[$i] if $r < $cumul[$i]; }
+	return $aa[-1];
+}
+
+sub random_seq {
+	my $len = shift;
+	return join('', map { random_aa() } 1..$len);
+}
+
+# protein lengths roughly follow a log-normal distribution with median around 280
+sub random_length {
+	my $l = int(exp(log(280) + 0.6 * sqrt(-2 * log(1 - rand())) * cos(6.2831853 * rand())));
+	return $l < 30 ? 30 : ($l > 3000 ? 3000 : $l);
+}
+
+# copy of a family member with substitutions and small indels
+sub mutate {
+	my ($seq, $rate) = @_;
+	my @s = split //, $seq;
+	my @out;
+	foreach my $c (@s) {
+		my $r = rand();
+		if($r < $rate) { push @out, random_aa(); }
+		elsif($r < $rate * 1.05) { next; }
+		elsif($r < $rate * 1.1) { push @out, $c, random_aa(); }
+		else { push @out, $c; }
+	}
+	return join('', @out);
+}
+
+sub low_complexity {
+	my $period = 1 + int(rand(4));
+	my $motif = random_seq($period);
+	my $len = 10 + int(rand(50));
+	return substr($motif x (int($len / $period) + 1), 0, $len);
+}
+
+my @families;
+my $written = 0;
+my $n = 0;
+while($written < $total) {
+	my $seq;
+	if(@families == 0 || rand() < 0.4) {
+		$seq = random_seq(random_length());
+		push @families, $seq;
+	}
+	else {
+		# skewed choice of the family, so that a few families get very many copies
+		my $f = $families[int(@families * rand() ** 4)];
+		$seq = mutate($f, rand() < 0.2 ? 0.0 : rand(0.3));
+	}
+	if(rand() < 0.1) { # insert low-complexity stretch
+		my $pos = int(rand(length($seq)));
+		substr($seq, $pos, 0) = low_complexity();
+	}
+	if(rand() < 0.05) { # insert homopolymer
+		my $pos = int(rand(length($seq)));
+		substr($seq, $pos, 0) = random_aa() x (8 + int(rand(30)));
+	}
+	$n++;
+	my $taxid = 1 + int(rand(5000));
+	print ">$n\_$taxid\n$seq\n";
+	$written += length($seq);
+}